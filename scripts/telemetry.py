@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""Read telemetry and profiles from passinglink devices over the vendor HID feature reports.
+
+Requires the hidapi bindings (`pip install hidapi`). Every connected HID device that answers the
+telemetry report is printed, optionally repeatedly.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import hid
+
+TELEMETRY_REPORT_ID = 0x48
+TELEMETRY_LATENCY_REPORT_ID = 0x49
+TELEMETRY_PROFILE_REPORT_ID = 0x4A
+TELEMETRY_POLL_REPORT_ID = 0x4B
+TELEMETRY_RESET_MAGIC = 0x1209214F
+
+# PLTelemetry and PLTelemetryLatency in src/output/usb/hid.h.
+TELEMETRY_FORMAT = struct.Struct("<BIIIIIIIII")
+TELEMETRY_FIELDS = [
+    "reports",
+    "write_failures",
+    "missed_polls",
+    "get_report_avg_ns",
+    "get_report_max_ns",
+    "report_delay_us",
+    "queue_high_water",
+    "queue_capacity",
+    "allocator_high_water",
+]
+
+LATENCY_FORMAT = struct.Struct("<BIIIIIII")
+LATENCY_FIELDS = ["count", "min", "p50", "p90", "p99", "p999", "max"]
+
+# PLTelemetryPoll in src/output/usb/hid.h.
+POLL_FORMAT = struct.Struct("<B8sIIIIIIIIIIIII")
+POLL_FIELDS = [
+    "backend",
+    "report_delay_us",
+    "poll_interval_us",
+    "intervals",
+    "interval_min_us",
+    "interval_max_us",
+    "jitter_p50_us",
+    "jitter_p99_us",
+    "jitter_p999_us",
+    "jitter_max_us",
+    "missed_polls",
+    "write_failures",
+    "requeues",
+    "max_failure_streak",
+]
+
+# PLTelemetryProfile in src/output/usb/hid.h.
+PROFILE_FORMAT = struct.Struct("<BBB20sIIQIIII")
+PROFILE_FIELDS = [
+    "index",
+    "count",
+    "name",
+    "cycles_per_second",
+    "calls",
+    "total_cycles",
+    "min_cycles",
+    "p50_cycles",
+    "p99_cycles",
+    "max_cycles",
+]
+
+
+def get_feature(device, report_id, fmt):
+    data = bytes(device.get_feature_report(report_id, 64))
+
+    # The device doesn't prefix the report with its id, but some hidapi backends add it.
+    offset = 1 if data[:1] == bytes([report_id]) else 0
+    if len(data) < offset + fmt.size:
+        return None
+    values = fmt.unpack_from(data, offset)
+    if values[0] != 1:
+        return None
+    return values[1:]
+
+
+def read_telemetry(device):
+    telemetry = get_feature(device, TELEMETRY_REPORT_ID, TELEMETRY_FORMAT)
+    latency = get_feature(device, TELEMETRY_LATENCY_REPORT_ID, LATENCY_FORMAT)
+    if telemetry is None or latency is None:
+        return None
+    return dict(zip(TELEMETRY_FIELDS, telemetry)), dict(zip(LATENCY_FIELDS, latency))
+
+
+def read_poll(device):
+    values = get_feature(device, TELEMETRY_POLL_REPORT_ID, POLL_FORMAT)
+    if values is None:
+        return None
+    poll = dict(zip(POLL_FIELDS, values))
+    poll["backend"] = poll["backend"].split(b"\0")[0].decode(errors="replace")
+    return poll
+
+
+def read_profiles(device):
+    device.send_feature_report([TELEMETRY_PROFILE_REPORT_ID, 0])
+    profiles = []
+    while True:
+        values = get_feature(device, TELEMETRY_PROFILE_REPORT_ID, PROFILE_FORMAT)
+        if values is None:
+            return profiles
+        profile = dict(zip(PROFILE_FIELDS, values))
+        if profile["index"] >= profile["count"]:
+            return profiles
+        profile["name"] = profile["name"].split(b"\0")[0].decode(errors="replace")
+        profiles.append(profile)
+        if len(profiles) == profile["count"]:
+            return profiles
+
+
+def cycles_to_us(profile, cycles):
+    return cycles * 1e6 / profile["cycles_per_second"]
+
+
+def open_devices():
+    devices = []
+    seen = set()
+    for info in hid.enumerate():
+        if info["path"] in seen:
+            continue
+        seen.add(info["path"])
+
+        device = hid.device()
+        try:
+            device.open_path(info["path"])
+            if read_telemetry(device) is None:
+                device.close()
+                continue
+        except (IOError, OSError):
+            device.close()
+            continue
+
+        name = "{:04x}:{:04x} {}".format(
+            info["vendor_id"], info["product_id"], info["path"].decode(errors="replace")
+        )
+        devices.append((name, device))
+    return devices
+
+
+def print_poll(poll):
+    print(
+        "  polling ({backend}, {poll_interval_us} us interval, {report_delay_us} us delay): "
+        "{intervals} intervals, min {interval_min_us} us, max {interval_max_us} us".format(**poll)
+    )
+    print(
+        "  jitter: p50 {jitter_p50_us} us, p99 {jitter_p99_us} us, p99.9 {jitter_p999_us} us, "
+        "max {jitter_max_us} us".format(**poll)
+    )
+    print(
+        "  missed polls: {missed_polls}, write failures: {write_failures}, requeues: {requeues}, "
+        "longest failure run: {max_failure_streak}".format(**poll)
+    )
+
+
+def print_profiles(profiles):
+    for profile in profiles:
+        calls = profile["calls"]
+        average = profile["total_cycles"] / calls if calls else 0
+        print(
+            "  {}: {} calls, avg {:.1f} us, min {:.1f} us, p50 {:.1f} us, p99 {:.1f} us, "
+            "max {:.1f} us".format(
+                profile["name"],
+                calls,
+                cycles_to_us(profile, average),
+                cycles_to_us(profile, profile["min_cycles"]),
+                cycles_to_us(profile, profile["p50_cycles"]),
+                cycles_to_us(profile, profile["p99_cycles"]),
+                cycles_to_us(profile, profile["max_cycles"]),
+            )
+        )
+
+
+def print_telemetry(name, telemetry, latency):
+    print(name)
+    print(
+        "  reports: {reports}, write failures: {write_failures}, missed polls: {missed_polls}".format(
+            **telemetry
+        )
+    )
+    print(
+        "  GetReport: avg {get_report_avg_ns} ns, max {get_report_max_ns} ns, "
+        "report delay: {report_delay_us} us".format(**telemetry)
+    )
+    print(
+        "  queue high water: {queue_high_water}/{queue_capacity} bytes, "
+        "allocator high water: {allocator_high_water} bytes".format(**telemetry)
+    )
+    print(
+        "  latency ({count} reports): min {min} us, p50 {p50} us, p90 {p90} us, "
+        "p99 {p99} us, p99.9 {p999} us, max {max} us".format(**latency)
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--reset", action="store_true", help="reset telemetry after connecting")
+    parser.add_argument(
+        "--interval", type=float, help="keep printing telemetry every INTERVAL seconds"
+    )
+    args = parser.parse_args()
+
+    devices = open_devices()
+    if not devices:
+        print("no devices found", file=sys.stderr)
+        return 1
+
+    if args.reset:
+        payload = [TELEMETRY_REPORT_ID] + list(struct.pack("<I", TELEMETRY_RESET_MAGIC))
+        for _, device in devices:
+            device.send_feature_report(payload)
+
+    while True:
+        for name, device in devices:
+            result = read_telemetry(device)
+            if result is None:
+                print("{}: failed to read telemetry".format(name), file=sys.stderr)
+                continue
+            print_telemetry(name, *result)
+            poll = read_poll(device)
+            if poll is not None:
+                print_poll(poll)
+            print_profiles(read_profiles(device))
+
+        if args.interval is None:
+            return 0
+        time.sleep(args.interval)
+        print()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
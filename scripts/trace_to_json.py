@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Convert the output of the `trace dump` shell command into Chrome trace JSON.
+
+The result can be loaded into chrome://tracing or https://ui.perfetto.dev. Lines that aren't part
+of the dump (e.g. log messages, or the shell prompt) are ignored.
+
+usage: trace_to_json.py [DUMP] > trace.json
+"""
+
+import json
+import re
+import sys
+
+# PL_TRACE_STAGES in src/metrics/trace.h.
+STAGES = [
+    "GpioSample",
+    "DebounceResult",
+    "SOCDResolve",
+    "ReportEncodeBegin",
+    "ReportEncodeEnd",
+    "UsbWriteBegin",
+    "UsbWriteEnd",
+    "IntInReady",
+    "TouchpadI2CBegin",
+    "TouchpadI2CEnd",
+    "DisplayBlitBegin",
+    "DisplayBlitEnd",
+]
+
+HEADER = re.compile(r"trace: (\d+) cycles/s, (\d+) entries")
+ENTRY = re.compile(r"\b([0-9a-f]{8}) ([0-9a-f]{8}) (\d+) ([0-9a-f]{8})\s*$")
+
+# Exception numbers below 16 are system exceptions, the rest are external interrupts.
+SYSTEM_EXCEPTIONS = {
+    2: "NMI",
+    3: "HardFault",
+    11: "SVCall",
+    14: "PendSV",
+    15: "SysTick",
+}
+
+
+def context_name(context):
+    if context < 16:
+        return SYSTEM_EXCEPTIONS.get(context, "exception {}".format(context))
+    elif context < 256:
+        return "IRQ {}".format(context - 16)
+    return "thread 0x{:08x}".format(context)
+
+
+def convert(lines):
+    cycles_per_us = None
+    entries = []
+    for line in lines:
+        header = HEADER.search(line)
+        if header:
+            cycles_per_us = int(header.group(1)) / 1e6
+            entries = []
+            continue
+
+        entry = ENTRY.search(line)
+        if entry and cycles_per_us is not None:
+            cycle, context, stage, arg = entry.groups()
+            entries.append((int(cycle, 16), int(context, 16), int(stage), int(arg, 16)))
+
+    if cycles_per_us is None:
+        raise ValueError("no trace dump found")
+
+    events = []
+    contexts = set()
+    elapsed = 0
+    previous = entries[0][0] if entries else 0
+    for cycle, context, stage, arg in entries:
+        # Cycle counts are 32 bits, unwrap them. Entries aren't strictly in cycle order (an
+        # interrupt can record between another entry claiming its slot and reading the clock), so
+        # treat the difference as signed, and sort the events afterwards.
+        delta = (cycle - previous) & 0xFFFFFFFF
+        if delta >= 0x80000000:
+            delta -= 0x100000000
+        elapsed += delta
+        previous = cycle
+
+        name = STAGES[stage] if stage < len(STAGES) else "stage {}".format(stage)
+        event = {
+            "ts": elapsed / cycles_per_us,
+            "pid": 0,
+            "tid": context,
+            "args": {"arg": arg},
+        }
+
+        if name.endswith("Begin"):
+            event.update(name=name[: -len("Begin")], ph="B")
+        elif name.endswith("End"):
+            event.update(name=name[: -len("End")], ph="E")
+        else:
+            event.update(name=name, ph="i", s="t")
+
+        events.append(event)
+        contexts.add(context)
+
+    events.sort(key=lambda event: event["ts"])
+    if events:
+        start = events[0]["ts"]
+        for event in events:
+            event["ts"] -= start
+
+    for context in sorted(contexts):
+        events.append(
+            {
+                "name": "thread_name",
+                "ph": "M",
+                "pid": 0,
+                "tid": context,
+                "args": {"name": context_name(context)},
+            }
+        )
+
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    if len(sys.argv) > 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+
+    if len(sys.argv) == 2:
+        with open(sys.argv[1]) as f:
+            trace = convert(f)
+    else:
+        trace = convert(sys.stdin)
+
+    json.dump(trace, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -344,25 +344,31 @@ struct OutputMenu : public Menu {
 };
 
 size_t usb_delay_print(span<char> buf) {
-  uint32_t ticks = usb_hid_get_report_delay_ticks();
-  return snprintf(buf.data(), buf.size(), "%" PRIu32 " ticks", ticks);
+  uint32_t us = usb_hid_get_report_delay_us();
+  return snprintf(buf.data(), buf.size(), "%" PRIu32 " us", us);
 }
 
 void usb_delay_increase() {
-  uint32_t ticks = usb_hid_get_report_delay_ticks();
-  if (k_ticks_to_us_ceil32(ticks) > 1000) {
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+  usb_hid_set_report_delay_auto(false);
+#endif
+  uint32_t us = usb_hid_get_report_delay_us();
+  if (us + USB_HID_REPORT_DELAY_STEP_US > 1000) {
     return;
   }
-  usb_hid_set_report_delay_ticks(ticks + 1);
+  usb_hid_set_report_delay_us(us + USB_HID_REPORT_DELAY_STEP_US);
   metrics_reset();
 }
 
 void usb_delay_decrease() {
-  uint32_t ticks = usb_hid_get_report_delay_ticks();
-  if (ticks == 0) {
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+  usb_hid_set_report_delay_auto(false);
+#endif
+  uint32_t us = usb_hid_get_report_delay_us();
+  if (us == 0) {
     return;
   }
-  usb_hid_set_report_delay_ticks(ticks - 1);
+  usb_hid_set_report_delay_us(us - min(us, USB_HID_REPORT_DELAY_STEP_US));
   metrics_reset();
 }
 
@@ -370,18 +376,30 @@ struct USBDelayMenu : public Menu {
   USBDelayMenu()
       : Menu("USB timing"),
         delay_("Delay: ", usb_delay_print),
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+        auto_enable_("Auto: enable", []() { usb_hid_set_report_delay_auto(true); }),
+        auto_disable_("Auto: disable", []() { usb_hid_set_report_delay_auto(false); }),
+#endif
         increase_("Increase", usb_delay_increase),
         decrease_("Decrease", usb_delay_decrease) {}
 
   size_t menu_items(span<MenuBase*> buffer) final {
     // TODO: Implement nonselectable items, so the cursor starts on increase.
-    buffer[0] = &delay_;
-    buffer[1] = &increase_;
-    buffer[2] = &decrease_;
-    return 3;
+    size_t i = 0;
+    buffer[i++] = &delay_;
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+    buffer[i++] = usb_hid_get_report_delay_auto() ? &auto_disable_ : &auto_enable_;
+#endif
+    buffer[i++] = &increase_;
+    buffer[i++] = &decrease_;
+    return i;
   }
 
   DynamicTextItem delay_;
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+  ActionItem auto_enable_;
+  ActionItem auto_disable_;
+#endif
   ActionItem increase_;
   ActionItem decrease_;
 };
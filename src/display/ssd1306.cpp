@@ -7,6 +7,7 @@
 #include <logging/log.h>
 
 #include "arch.h"
+#include "metrics/trace.h"
 #include "types.h"
 
 #include "display/font.h"
@@ -298,7 +299,9 @@ struct Display {
     if (dirty_) {
       // TODO: Double buffer?
       dirty_ = false;
+      TRACE(DisplayBlitBegin, 0);
       ssd1306_data(span(current_buffer()->buffer, 512));
+      TRACE(DisplayBlitEnd, 0);
     }
   }
 
@@ -0,0 +1,35 @@
+#include "input/clock.h"
+
+#include <zephyr.h>
+
+#include "types.h"
+
+// The number of half wraparounds (2^31 cycles) of the 32-bit counter so far, which are the upper
+// bits of the clock. Its low bit matches the top bit of the counter, except just after a half
+// wraparound, which the first reader to notice moves past with a compare and swap.
+static atomic_t clock_half_wraps;
+
+uint64_t input_clock_now() {
+  while (true) {
+    uint32_t half_wraps = atomic_get(&clock_half_wraps);
+    uint32_t sample = input_clock_sample();
+    if ((sample >> 31) == (half_wraps & 1)) {
+      return static_cast<uint64_t>(half_wraps) << 31 | (sample & INT32_MAX);
+    }
+    atomic_cas(&clock_half_wraps, half_wraps, half_wraps + 1);
+  }
+}
+
+// The clock has to be read at least once per half wraparound of the 32-bit counter (every ~30
+// seconds at 72 MHz), even if nothing is reading input.
+static void input_clock_refresh(struct k_timer*) {
+  input_clock_now();
+}
+
+K_TIMER_DEFINE(input_clock_timer, input_clock_refresh, nullptr);
+
+void input_clock_init() {
+  input_clock_now();
+  k_timeout_t period = K_SECONDS(1);
+  k_timer_start(&input_clock_timer, period, period);
+}
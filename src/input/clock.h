@@ -0,0 +1,35 @@
+#pragma once
+
+#include <zephyr.h>
+
+// Monotonic 64-bit clock that timestamps everything in the input path: debounce, SOCD, the input
+// lock, the input queue, recordings and metrics. It counts hardware cycles (k_cycle_get_32), so
+// convert durations with k_ms_to_cyc_* and k_cyc_to_*. Values of this clock are what "tick"
+// refers to throughout the input code.
+//
+// Unlike get_cycle_count, it keeps counting while the core sleeps, so it's also what intervals
+// that span idle time (e.g. between USB polls) should be measured with. Its resolution depends on
+// the system timer: on STM32 it's the CPU clock (SysTick), so inputs that change within the same
+// kernel tick are still ordered correctly. On nRF52 it's the 32.768 kHz RTC, which is no finer
+// than a kernel tick (~30 us), so there, inputs that change within the same tick get the same
+// timestamp and aren't ordered.
+//
+// input_clock_init starts a timer that keeps the clock refreshed, so differences between values of
+// it are correct however far apart they were read (e.g. the delays between input changes in a
+// recording), even if the hardware counter wrapped around in between.
+void input_clock_init();
+
+// Lock-free, and safe to call from any context.
+uint64_t input_clock_now();
+
+// Sample the low 32 bits of the clock, e.g. to cheaply timestamp an event in an ISR.
+inline uint32_t input_clock_sample() {
+  return k_cycle_get_32();
+}
+
+// Extend a sample to the full clock, given a later value of the clock. The sample must be less
+// than a wraparound of the 32-bit counter old; samples taken after now are clamped to it.
+inline uint64_t input_clock_extend(uint32_t sample, uint64_t now) {
+  int32_t age = static_cast<uint32_t>(now) - sample;
+  return age > 0 ? now - age : now;
+}
@@ -0,0 +1,70 @@
+#include "input/debounce.h"
+
+#include <zephyr.h>
+
+#include "input/clock.h"
+#include "input/input.h"
+#include "input/pipeline.h"
+#include "types.h"
+
+// Only allow transitions every 5 milliseconds (in ticks of the input clock).
+// TODO: Make configurable?
+static constexpr uint64_t transition_time = k_ms_to_cyc_ceil64(5);
+
+static void input_debounce_unlock(InputPipeline* pipeline, uint64_t current_tick) {
+  if (!pipeline->debounce_locked || current_tick < pipeline->debounce_next_unlock) {
+    return;
+  }
+
+  uint64_t next_unlock = UINT64_MAX;
+  uint32_t locked = pipeline->debounce_locked;
+  while (locked) {
+    size_t index = __builtin_ctz(locked);
+    locked &= locked - 1;
+
+    uint64_t unlock_tick = pipeline->button_history.values[index].tick + transition_time;
+    if (current_tick >= unlock_tick) {
+      pipeline->debounce_locked &= ~BIT(index);
+    } else {
+      next_unlock = min(next_unlock, unlock_tick);
+    }
+  }
+  pipeline->debounce_next_unlock = next_unlock;
+}
+
+uint32_t input_debounce(InputPipeline* pipeline, uint32_t raw_state, uint64_t current_tick) {
+  input_debounce_unlock(pipeline, current_tick);
+
+  uint32_t& debounce_state = pipeline->debounce_state;
+  uint32_t accepted =
+    (raw_state ^ debounce_state) & ~pipeline->debounce_locked & PL_GPIO_AVAILABLE_MASK;
+  if (!accepted) {
+    return debounce_state;
+  }
+
+  debounce_state ^= accepted;
+  pipeline->debounce_locked |= accepted;
+  pipeline->debounce_next_unlock =
+    min(pipeline->debounce_next_unlock, current_tick + transition_time);
+
+  // Record the transitions for consumers that need to know when they happened (e.g. SOCD).
+  while (accepted) {
+    size_t index = __builtin_ctz(accepted);
+    accepted &= accepted - 1;
+
+    pipeline->button_history.values[index].state = debounce_state & BIT(index);
+    pipeline->button_history.values[index].tick = current_tick;
+  }
+
+  return debounce_state;
+}
+
+void input_debounce_edge(InputPipeline* pipeline, size_t index, bool value, uint64_t tick) {
+  uint32_t state = pipeline->debounce_state;
+  uint32_t raw_state = value ? (state | BIT(index)) : (state & ~BIT(index));
+  input_debounce(pipeline, raw_state, tick);
+}
+
+uint32_t input_debounce_get_state(const InputPipeline* pipeline) {
+  return pipeline->debounce_state;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct InputPipeline;
+
+// Debounce every input at once, given a mask with the layout of RawInputState.
+// Returns the debounced state, and updates the pipeline's button_history for inputs that
+// transitioned.
+//
+// Debouncing is eager: a change is accepted immediately, as long as the input hasn't
+// transitioned within the last 5 milliseconds.
+uint32_t input_debounce(InputPipeline* pipeline, uint32_t raw_state, uint64_t current_tick);
+
+// Debounce a single input that changed value at tick.
+// Ticks passed must be monotonic across calls to input_debounce and input_debounce_edge.
+void input_debounce_edge(InputPipeline* pipeline, size_t index, bool value, uint64_t tick);
+
+uint32_t input_debounce_get_state(const InputPipeline* pipeline);
@@ -12,22 +12,39 @@ LOG_MODULE_REGISTER(input);
 
 #include "arch.h"
 #include "display/display.h"
+#include "input/clock.h"
+#include "input/debounce.h"
+#include "input/pipeline.h"
 #include "input/profile.h"
 #include "input/queue.h"
+#include "input/record.h"
 #include "input/socd.h"
 #include "input/touchpad.h"
+#include "metrics/trace.h"
 #include "panic.h"
 #include "profiling.h"
 #include "types.h"
 
 TouchpadData touchpad_data;
 
+// The pipeline behind input_get_state. Edges from edge capture are debounced into it directly.
+static InputPipeline input_pipeline;
+
 static void input_gpio_init();
 
+#if defined(CONFIG_PASSINGLINK_INPUT_SAMPLER)
+static void input_sampler_init();
+#endif
+
 void input_init() {
+  input_clock_init();
   input_gpio_init();
   input_profile_init();
   input_touchpad_init();
+
+#if defined(CONFIG_PASSINGLINK_INPUT_SAMPLER)
+  input_sampler_init();
+#endif
 }
 
 #if defined(CONFIG_PASSINGLINK_INPUT_NONE)
@@ -48,7 +65,9 @@ bool input_get_raw_state(RawInputState* out) {
 
 #elif defined(CONFIG_PASSINGLINK_INPUT_EXTERNAL)
 
-static RawInputState input_state;
+// Written from the BT RX and shell threads and read from wherever reports are generated: a single
+// atomic word avoids both torn reads and locking interrupts.
+static atomic_u32<RawInputState> input_state;
 
 static void input_gpio_init() {}
 
@@ -60,12 +79,12 @@ bool input_get_raw_state(RawInputState* out) {
   }
 #endif
 
-  *out = input_state;
+  *out = input_state.load();
   return true;
 }
 
 void input_set_raw_state(RawInputState* in) {
-  input_state = *in;
+  input_state.store(*in);
 }
 
 #else
@@ -75,7 +94,148 @@ void input_set_raw_state(RawInputState* in) {
 static const struct device* gpio_devices[GPIO_PORT_COUNT];
 static uint8_t gpio_device_count;
 
-static uint8_t gpio_indices[PL_GPIO_COUNT];
+// Compile-time plan for gathering the values of every input from the raw GPIO port values.
+//
+// Inputs on the same port whose RawInputState offset is the same distance from their pin number
+// can be moved into place together with a single mask and shift, so each port is extracted with
+// one step per distinct distance, instead of one read-modify-write per input.
+struct InputGatherStep {
+  gpio_port_pins_t mask;
+
+  // RawInputState offset minus pin number.
+  int8_t shift;
+};
+
+struct InputGatherPort {
+  const char* label;
+  size_t step_count;
+  InputGatherStep steps[PL_GPIO_COUNT];
+};
+
+struct InputGatherPlan {
+  size_t port_count;
+  InputGatherPort ports[GPIO_PORT_COUNT];
+
+  // GPIO_ACTIVE_LOW inputs, to be inverted after gathering.
+  uint32_t active_low;
+
+  bool overflowed;
+};
+
+struct InputGpio {
+  const char* label;
+  uint8_t pin;
+  uint8_t index;
+  bool active_low;
+};
+
+static constexpr InputGpio input_gpios[] = {
+#define PL_GPIO(index, name, available)                                                        \
+  COND_CODE_1(available,                                                                       \
+              ({ PL_GPIO_LABEL(name), PL_GPIO_PIN(name), index,                                \
+                 (PL_GPIO_FLAGS(name) & GPIO_ACTIVE_LOW) != 0 },),                             \
+              ())
+  PL_GPIOS()
+#undef PL_GPIO
+};
+
+static constexpr bool input_gather_label_equal(const char* a, const char* b) {
+  while (*a && *a == *b) {
+    ++a;
+    ++b;
+  }
+  return *a == *b;
+}
+
+static constexpr InputGatherPlan input_gather_plan() {
+  InputGatherPlan plan = {};
+  for (const InputGpio& gpio : input_gpios) {
+    size_t port_index = 0;
+    while (port_index < plan.port_count &&
+           !input_gather_label_equal(plan.ports[port_index].label, gpio.label)) {
+      ++port_index;
+    }
+
+    if (port_index == plan.port_count) {
+      if (plan.port_count == GPIO_PORT_COUNT) {
+        plan.overflowed = true;
+        return plan;
+      }
+      plan.ports[plan.port_count++].label = gpio.label;
+    }
+
+    InputGatherPort& port = plan.ports[port_index];
+    int8_t shift = static_cast<int8_t>(gpio.index - gpio.pin);
+    size_t step_index = 0;
+    while (step_index < port.step_count && port.steps[step_index].shift != shift) {
+      ++step_index;
+    }
+
+    if (step_index == port.step_count) {
+      port.steps[port.step_count++].shift = shift;
+    }
+    port.steps[step_index].mask |= 1U << gpio.pin;
+
+    if (gpio.active_low) {
+      plan.active_low |= 1U << gpio.index;
+    }
+  }
+  return plan;
+}
+
+static constexpr InputGatherPlan input_gather = input_gather_plan();
+static_assert(!input_gather.overflowed, "too many GPIO ports, increase GPIO_PORT_COUNT");
+
+#if defined(CONFIG_PASSINGLINK_INPUT_GPIO_EDGE_CAPTURE)
+// A single GPIO transition, captured by the GPIO interrupt handler.
+struct InputEdge {
+  // input_clock_sample() at which the interrupt fired.
+  uint32_t cycle;
+
+  // Offset of the input in RawInputState.
+  uint8_t index;
+
+  // Logical value of the input after the transition (i.e. with GPIO_ACTIVE_LOW applied).
+  uint8_t value;
+};
+
+struct InputEdgeCallback {
+  struct gpio_callback callback;
+  uint8_t device_index;
+};
+
+// Every port's interrupt pushes onto this, and ports can have different interrupt priorities, so
+// pushes are made with interrupts locked to keep the queue single producer.
+static spsc_queue<InputEdge, 64> input_edges;
+static atomic_t input_edges_overflowed;
+
+static InputEdgeCallback input_edge_callbacks[GPIO_PORT_COUNT];
+
+// Per-port lookup tables, indexed by pin number.
+static uint8_t input_edge_indices[GPIO_PORT_COUNT][32];
+static gpio_port_pins_t input_edge_pins[GPIO_PORT_COUNT];
+static gpio_port_pins_t input_edge_active_low[GPIO_PORT_COUNT];
+
+// Whether interrupts were successfully enabled on every pin.
+// If this is false, we fall back to polling every port.
+static bool input_edge_enabled;
+
+// The current value of every input, as reconstructed from the captured edges.
+static uint32_t input_edge_state;
+#endif
+
+static void input_edge_register(uint8_t device_index, gpio_pin_t pin, size_t index,
+                                bool active_low) {
+#if defined(CONFIG_PASSINGLINK_INPUT_GPIO_EDGE_CAPTURE)
+  input_edge_indices[device_index][pin] = index;
+  input_edge_pins[device_index] |= BIT(pin);
+  if (active_low) {
+    input_edge_active_low[device_index] |= BIT(pin);
+  }
+#endif
+}
+
+static void input_edge_init();
 
 static uint8_t gpio_device_add(const struct device* device) {
   uint8_t i;
@@ -95,6 +255,15 @@ static uint8_t gpio_device_add(const struct device* device) {
 }
 
 static void input_gpio_init() {
+  // Cache the devices in the same order as the gather plan.
+  for (size_t i = 0; i < input_gather.port_count; ++i) {
+    const struct device* device = device_get_binding(input_gather.ports[i].label);
+    if (!device) {
+      PANIC("failed to find gpio device %s", input_gather.ports[i].label);
+    }
+    gpio_device_add(device);
+  }
+
 #define PL_GPIO(index, name, available)                                                           \
   COND_CODE_1(                                                                                    \
     available, ({                                                                                 \
@@ -107,44 +276,181 @@ static void input_gpio_init() {
               PL_GPIO_PIN(name));                                                                 \
       };                                                                                          \
       uint8_t device_offset = gpio_device_add(device);                                            \
-      gpio_indices[index] = device_offset;                                                        \
+      input_edge_register(device_offset, PL_GPIO_PIN(name), index,                                \
+                          PL_GPIO_FLAGS(name) & GPIO_ACTIVE_LOW);                                 \
     }),                                                                                           \
     ())
   PL_GPIOS()
 #undef PL_GPIO
+
+  input_edge_init();
+}
+
+// Read the current value of every input directly from the GPIO ports.
+static void input_gpio_poll(RawInputState* out) {
+  uint32_t result = 0;
+  for (size_t i = 0; i < input_gather.port_count; ++i) {
+    gpio_port_value_t value;
+    if (gpio_port_get_raw(gpio_devices[i], &value) != 0) {
+      PANIC("failed to get gpio values");
+    }
+
+    const InputGatherPort& port = input_gather.ports[i];
+    for (size_t j = 0; j < port.step_count; ++j) {
+      const InputGatherStep& step = port.steps[j];
+      uint32_t bits = value & step.mask;
+      result |= step.shift >= 0 ? bits << step.shift : bits >> -step.shift;
+    }
+  }
+
+  *out = raw_input_state_from_mask(result ^ input_gather.active_low);
+  TRACE(GpioSample, result ^ input_gather.active_low);
+}
+
+#if defined(CONFIG_PASSINGLINK_INPUT_GPIO_EDGE_CAPTURE)
+static void input_edge_isr(const struct device* port, struct gpio_callback* callback,
+                           gpio_port_pins_t pins) {
+  uint32_t cycle = input_clock_sample();
+  uint8_t device_index = CONTAINER_OF(callback, InputEdgeCallback, callback)->device_index;
+
+  gpio_port_value_t value;
+  if (gpio_port_get_raw(port, &value) != 0) {
+    atomic_set(&input_edges_overflowed, 1);
+    return;
+  }
+  value ^= input_edge_active_low[device_index];
+
+  pins &= input_edge_pins[device_index];
+  ScopedIRQLock lock;
+  while (pins) {
+    gpio_pin_t pin = __builtin_ctz(pins);
+    pins &= pins - 1;
+
+    InputEdge edge = {
+      .cycle = cycle,
+      .index = input_edge_indices[device_index][pin],
+      .value = static_cast<uint8_t>((value >> pin) & 1),
+    };
+    if (!input_edges.push(edge)) {
+      atomic_set(&input_edges_overflowed, 1);
+    }
+  }
+}
+
+static void input_edge_uninit() {
+  for (uint8_t i = 0; i < gpio_device_count; ++i) {
+    gpio_port_pins_t pins = input_edge_pins[i];
+    while (pins) {
+      gpio_pin_t pin = __builtin_ctz(pins);
+      pins &= pins - 1;
+      gpio_pin_interrupt_configure(gpio_devices[i], pin, GPIO_INT_DISABLE);
+    }
+    gpio_remove_callback(gpio_devices[i], &input_edge_callbacks[i].callback);
+  }
+}
+
+static void input_edge_init() {
+  for (uint8_t i = 0; i < gpio_device_count; ++i) {
+    input_edge_callbacks[i].device_index = i;
+    gpio_init_callback(&input_edge_callbacks[i].callback, input_edge_isr, input_edge_pins[i]);
+    if (gpio_add_callback(gpio_devices[i], &input_edge_callbacks[i].callback) != 0) {
+      LOG_WRN("failed to add gpio callback (device = %s), falling back to polling",
+              gpio_devices[i]->name);
+      input_edge_uninit();
+      return;
+    }
+  }
+
+  for (uint8_t i = 0; i < gpio_device_count; ++i) {
+    gpio_port_pins_t pins = input_edge_pins[i];
+    while (pins) {
+      gpio_pin_t pin = __builtin_ctz(pins);
+      pins &= pins - 1;
+
+      // This can fail if pins share an interrupt line (e.g. PA1 and PB1 on STM32).
+      int rc = gpio_pin_interrupt_configure(gpio_devices[i], pin, GPIO_INT_EDGE_BOTH);
+      if (rc != 0) {
+        LOG_WRN("failed to enable gpio interrupt (device = %s, pin = %d): rc = %d, falling back "
+                "to polling",
+                gpio_devices[i]->name, pin, rc);
+        input_edge_uninit();
+        return;
+      }
+    }
+  }
+
+  // Interrupts are live: take a snapshot to start from. Any edges that race with this are
+  // queued, and will be applied on top of it.
+  RawInputState state;
+  input_gpio_poll(&state);
+  input_edge_state = raw_input_state_to_mask(state);
+  input_edge_enabled = true;
+  LOG_INF("gpio edge capture enabled");
+}
+
+// Apply captured edges to input_edge_state.
+// If debounce is true, also debounce them using the time at which the edge actually happened.
+static void input_edge_drain(bool debounce) {
+  if (atomic_clear(&input_edges_overflowed)) {
+    // Edges were dropped: resynchronize with the actual port values.
+    // Anything pushed after the clear happened after the poll, and will be reapplied next time.
+    LOG_WRN("gpio edge queue overflowed");
+    input_edges.clear();
+    RawInputState state;
+    input_gpio_poll(&state);
+    input_edge_state = raw_input_state_to_mask(state);
+    return;
+  }
+
+  uint64_t current_tick = input_clock_now();
+
+  InputEdge edge;
+  while (input_edges.pop(&edge)) {
+    if (edge.value) {
+      input_edge_state |= BIT(edge.index);
+    } else {
+      input_edge_state &= ~BIT(edge.index);
+    }
+
+    if (debounce) {
+      // Edges that arrived after we read the clock happened 'now'.
+      uint64_t edge_tick = input_clock_extend(edge.cycle, current_tick);
+      input_debounce_edge(&input_pipeline, edge.index, edge.value, edge_tick);
+    }
+  }
 }
+#else
+static void input_edge_init() {}
+#endif
 
 bool input_get_raw_state(RawInputState* out) {
-  PROFILE("input_get_raw_state", 128);
+  PROFILE("input_get_raw_state");
 
+#if defined(CONFIG_PASSINGLINK_INPUT_GPIO_EDGE_CAPTURE)
+  if (input_edge_enabled) {
 #if defined(CONFIG_PASSINGLINK_INPUT_QUEUE)
-  if (auto input = input_queue_get_state()) {
-    *out = *input;
+    if (auto input = input_queue_get_state()) {
+      // Keep track of the physical inputs, but don't let them affect the debounce state.
+      input_edge_drain(false);
+      *out = *input;
+      return true;
+    }
+#endif
+
+    input_edge_drain(true);
+    *out = raw_input_state_from_mask(input_edge_state);
     return true;
   }
 #endif
 
-  gpio_port_value_t port_values[GPIO_PORT_COUNT];
-  for (size_t i = 0; i < gpio_device_count; ++i) {
-    if (gpio_port_get_raw(gpio_devices[i], &port_values[i]) != 0) {
-      PANIC("failed to get gpio values");
-    }
+#if defined(CONFIG_PASSINGLINK_INPUT_QUEUE)
+  if (auto input = input_queue_get_state()) {
+    *out = *input;
+    return true;
   }
+#endif
 
-#define PL_GPIO(index, name, available)                                             \
-  COND_CODE_1(available, ({                                                         \
-                uint8_t device_index = gpio_indices[index];                         \
-                bool value = port_values[device_index] & (1U << PL_GPIO_PIN(name)); \
-                if constexpr (PL_GPIO_FLAGS(name) & GPIO_ACTIVE_LOW) {              \
-                  out->name = !value;                                               \
-                } else {                                                            \
-                  out->name = value;                                                \
-                }                                                                   \
-              }),                                                                   \
-              ())
-  PL_GPIOS()
-#undef PL_GPIO
-
+  input_gpio_poll(out);
   return true;
 }
 #endif
@@ -162,7 +468,7 @@ static bool input_locked = false;
 static uint64_t input_lock_tick;
 optional<uint64_t> input_get_lock_tick() {
   if (input_locked) {
-    return input_locked;
+    return input_lock_tick;
   }
   return {};
 }
@@ -179,30 +485,7 @@ static void input_set_locked(bool locked, uint64_t tick) {
 }
 
 void input_set_locked(bool locked) {
-  input_set_locked(locked, k_uptime_ticks());
-}
-
-ButtonHistory button_history;
-
-// Debounce a button input, given its history.
-// Updates history and returns the value that should be used.
-static bool input_debounce(bool current_state, ButtonHistory::Button* button_history,
-                           uint64_t current_tick) {
-  if (current_state == button_history->state) {
-    return current_state;
-  }
-
-  // Only allow transitions every 5 milliseconds.
-  // TODO: Make configurable?
-  uint64_t duration_ticks = current_tick - button_history->tick;
-  constexpr uint64_t transition_time = k_ms_to_cyc_ceil64(5);
-  if (duration_ticks < transition_time) {
-    return !current_state;
-  }
-
-  button_history->state = current_state;
-  button_history->tick = current_tick;
-  return current_state;
+  input_set_locked(locked, input_clock_now());
 }
 
 static void input_parse_mode(RawInputState* in) {
@@ -222,8 +505,8 @@ static void input_parse_mode(RawInputState* in) {
   }
 }
 
-static bool input_parse(InputState* out, RawInputState* in) {
-  PROFILE("input_parse", 128);
+bool input_parse(InputPipeline* pipeline, InputState* out, RawInputState* in) {
+  PROFILE("input_parse");
 
   // Initialize to neutral.
   memset(out, 0, sizeof(*out));
@@ -233,13 +516,17 @@ static bool input_parse(InputState* out, RawInputState* in) {
   out->right_stick_x = 128;
   out->right_stick_y = 128;
 
-  uint64_t current_tick = k_uptime_ticks();
+#if defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+  input_record_sample(*in);
+#endif
+
+  uint64_t current_tick = input_clock_now();
   // Debounce inputs.
-#define PL_GPIO(index, name, available) \
-  COND_CODE_1(available,                \
-              (in->name = input_debounce(in->name, &button_history.name, current_tick);), ())
-  PL_GPIOS()
-#undef PL_GPIO
+  // With edge capture, edges have already been debounced with their own timestamps as they were
+  // drained, and this only picks up changes that were previously rejected.
+  uint32_t debounced = input_debounce(pipeline, raw_input_state_to_mask(*in), current_tick);
+  TRACE(DebounceResult, debounced);
+  *in = raw_input_state_from_mask(debounced);
 
 #if defined(PL_GPIO_MODE_LOCK_AVAILABLE)
   input_set_locked(in->mode_lock, current_tick);
@@ -250,12 +537,64 @@ static bool input_parse(InputState* out, RawInputState* in) {
   // Copy TouchpadData.
   out->touchpad_data = touchpad_data;
 
-  input_profile_parse(out, in, current_tick);
+  input_profile_parse(pipeline, out, in, current_tick);
 
   return true;
 }
 
+#if defined(CONFIG_PASSINGLINK_INPUT_SAMPLER)
+// Input is sampled and parsed at a fixed rate on a dedicated thread, instead of when a report is
+// built. The result is published through a seqlock, so reports only need to copy it.
+//
+// The sampler runs at the highest cooperative priority, so that readers (e.g. the USB HID work
+// queue) can never preempt it in the middle of a write. Readers must not run in interrupt context,
+// since an interrupted write would never finish: this is why the sampler requires deferred USB
+// writes.
+static seqlock<InputState> input_sampler_state;
+
+K_TIMER_DEFINE(input_sampler_timer, nullptr, nullptr);
+
+static struct k_thread input_sampler_thread;
+K_THREAD_STACK_DEFINE(input_sampler_stack, 1536);
+
+static void input_sampler_run(void*, void*, void*) {
+  while (true) {
+    k_timer_status_sync(&input_sampler_timer);
+
+    RawInputState raw;
+    InputState state;
+    if (input_get_raw_state(&raw) && input_parse(&input_pipeline, &state, &raw)) {
+      input_sampler_state.store(state);
+    }
+  }
+}
+
+static void input_sampler_init() {
+  // Publish neutral inputs until the first sample is taken.
+  RawInputState raw = {};
+  InputState state;
+  input_parse(&input_pipeline, &state, &raw);
+  input_sampler_state.store(state);
+
+  k_timeout_t period = K_USEC(1'000'000 / CONFIG_PASSINGLINK_INPUT_SAMPLER_RATE);
+  k_timer_start(&input_sampler_timer, period, period);
+  k_thread_create(&input_sampler_thread, input_sampler_stack,
+                  K_THREAD_STACK_SIZEOF(input_sampler_stack), input_sampler_run, nullptr, nullptr,
+                  nullptr, -CONFIG_NUM_COOP_PRIORITIES, 0, K_NO_WAIT);
+  k_thread_name_set(&input_sampler_thread, "input_sampler");
+}
+
 bool input_get_state(InputState* out) {
+  *out = input_sampler_state.load();
+  return true;
+}
+#else
+bool input_get_state(InputState* out) {
+  return input_get_state(&input_pipeline, out);
+}
+#endif
+
+bool input_get_state(InputPipeline* pipeline, InputState* out) {
   RawInputState input;
-  return input_get_raw_state(&input) && input_parse(out, &input);
+  return input_get_raw_state(&input) && input_parse(pipeline, out, &input);
 }
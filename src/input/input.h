@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string.h>
+
 #include <kernel.h>
 
 #include "input/touchpad.h"
@@ -85,7 +87,7 @@ union ButtonHistory {
   struct Button {
     bool state;
 
-    // The cycle on which it entered the state.
+    // The tick of the input clock (see input/clock.h) on which it entered the state.
     uint64_t tick;
   };
 
@@ -98,8 +100,6 @@ union ButtonHistory {
   Button values[PL_GPIO_COUNT];
 };
 
-extern ButtonHistory button_history;
-
 struct RawInputState {
 #define PL_GPIO(index, name, available) \
   uint32_t name : 1;                    \
@@ -108,6 +108,29 @@ struct RawInputState {
 #undef PL_GPIO
 };
 
+static_assert(sizeof(RawInputState) == sizeof(uint32_t));
+
+// Bitmask of the GPIOs present on the board, with the same layout as RawInputState.
+static constexpr uint32_t PL_GPIO_AVAILABLE_MASK = 0
+#define PL_GPIO(index, name, available) | ((available) ? (1U << (index)) : 0U)
+  PL_GPIOS()
+#undef PL_GPIO
+  ;
+
+// RawInputState is a bitfield of PL_GPIO_COUNT bits, with RawInputState::foo_offset being the
+// offset of foo. Convert it to and from a plain mask to operate on every input at once.
+inline uint32_t raw_input_state_to_mask(const RawInputState& state) {
+  uint32_t result;
+  memcpy(&result, &state, sizeof(result));
+  return result;
+}
+
+inline RawInputState raw_input_state_from_mask(uint32_t mask) {
+  RawInputState result;
+  memcpy(&result, &mask, sizeof(result));
+  return result;
+}
+
 struct InputState {
   uint8_t left_stick_x;
   uint8_t left_stick_y;
@@ -131,6 +154,43 @@ struct InputState {
   TouchpadData touchpad_data;
 };
 
+constexpr size_t INPUT_STATE_BUTTON_COUNT = 14;
+
+// Buttons of an InputState as a mask, with bits in declaration order (button_north is bit 0).
+inline uint16_t input_state_buttons(const InputState& state) {
+  return state.button_north << 0 | state.button_east << 1 | state.button_south << 2 |
+         state.button_west << 3 | state.button_l1 << 4 | state.button_l2 << 5 |
+         state.button_l3 << 6 | state.button_r1 << 7 | state.button_r2 << 8 |
+         state.button_r3 << 9 | state.button_select << 10 | state.button_start << 11 |
+         state.button_home << 12 | state.button_touchpad << 13;
+}
+
+inline void input_state_set_buttons(InputState* state, uint16_t buttons) {
+  state->button_north = buttons >> 0;
+  state->button_east = buttons >> 1;
+  state->button_south = buttons >> 2;
+  state->button_west = buttons >> 3;
+  state->button_l1 = buttons >> 4;
+  state->button_l2 = buttons >> 5;
+  state->button_l3 = buttons >> 6;
+  state->button_r1 = buttons >> 7;
+  state->button_r2 = buttons >> 8;
+  state->button_r3 = buttons >> 9;
+  state->button_select = buttons >> 10;
+  state->button_start = buttons >> 11;
+  state->button_home = buttons >> 12;
+  state->button_touchpad = buttons >> 13;
+}
+
+// Compact summary of an InputState (excluding touchpad data), for cheaply detecting changes.
+inline uint64_t input_state_fingerprint(const InputState& state) {
+  uint64_t result = state.left_stick_x | state.left_stick_y << 8 | state.right_stick_x << 16 |
+                    static_cast<uint32_t>(state.right_stick_y) << 24;
+  result |= static_cast<uint64_t>(state.dpad) << 32;
+  result |= static_cast<uint64_t>(input_state_buttons(state)) << 40;
+  return result;
+}
+
 void input_init();
 
 optional<uint64_t> input_get_lock_tick();
@@ -152,8 +212,14 @@ bool input_get_raw_state(RawInputState* out);
 void input_set_raw_state(RawInputState* out);
 #endif
 
-// Parse a RawInputState into host-facing output.
-bool input_parse(InputState* out, const RawInputState* in);
+struct InputPipeline;
+
+// Parse a RawInputState into host-facing output, using and updating the pipeline's state.
+// in is replaced with its debounced value.
+bool input_parse(InputPipeline* pipeline, InputState* out, RawInputState* in);
 
 // Get the parsed button state.
 bool input_get_state(InputState* out);
+
+// Get the parsed button state, from a consumer's own pipeline.
+bool input_get_state(InputPipeline* pipeline, InputState* out);
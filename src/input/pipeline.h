@@ -0,0 +1,26 @@
+#pragma once
+
+#include "input/input.h"
+#include "input/profile_types.h"
+#include "input/socd.h"
+
+// The state that parsing RawInputState into InputState carries from one call to the next.
+//
+// Every consumer that parses input at its own cadence needs a pipeline of its own, so that it
+// doesn't corrupt the debounce history of the others. input_get_state uses a shared one.
+struct InputPipeline {
+  // Debounced value of every input, with the layout of RawInputState.
+  uint32_t debounce_state = 0;
+
+  // Inputs that transitioned too recently to change again.
+  // Every input starts out locked, as if it had transitioned at tick 0.
+  uint32_t debounce_locked = PL_GPIO_AVAILABLE_MASK;
+
+  // The earliest tick at which an input in debounce_locked unlocks.
+  uint64_t debounce_next_unlock = 0;
+
+  // The debounced state of each input, and when it entered it.
+  ButtonHistory button_history = {};
+
+  bool menu_opened = false;
+};
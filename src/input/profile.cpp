@@ -1,30 +1,130 @@
 #include "input/profile.h"
 
+#include <zephyr.h>
+
+#include <drivers/flash.h>
+#include <storage/flash_map.h>
+
+#include <logging/log.h>
+
 #include "display/menu.h"
 #include "input/input.h"
+#include "input/pipeline.h"
+#include "input/profile_types.h"
 #include "input/socd.h"
+#include "metrics/trace.h"
 #include "types.h"
 
+#define LOG_LEVEL LOG_LEVEL_INF
+LOG_MODULE_REGISTER(profile);
+
 // Struct representing button remapping in a profile.
 //
 // If ButtonMapping::button_foo == RawInputState::button_baz_offset, then when
 // the physical button_baz is pressed, it is interpreted as button_foo.
 //
 // 0xFF is treated specially as a nonexistent button.
-//
-// This could be a function in each Profile, but to more easily support custom profiles,
-// track these mappings as data instead.
 struct ButtonMapping {
 #define PL_GPIO(index, name, available) uint8_t name;
   PL_GPIOS()
 #undef PL_GPIO
 };
 
-struct Profile {
-  virtual const char* name() = 0;
-  virtual const ButtonMapping* button_mapping() = 0;
-  virtual size_t socd_x(span<SOCDInputs> out, const RawInputState* in) = 0;
-  virtual size_t socd_y(span<SOCDInputs> out, const RawInputState* in) = 0;
+static_assert(sizeof(ButtonMapping) == sizeof(CustomProfile::mapping));
+
+struct ProfileSOCDInput {
+  uint8_t input;
+  SOCDButtonType button_type;
+  bool overrides;
+};
+
+// Everything that makes up a profile, as data, so that built-in and custom profiles are handled
+// the same way.
+struct ProfileDescriptor {
+  constexpr void add_x(uint8_t input, SOCDButtonType type, bool overrides = false) {
+    socd_x[socd_x_count++] = { input, type, overrides };
+  }
+
+  constexpr void add_y(uint8_t input, SOCDButtonType type, bool overrides = false) {
+    socd_y[socd_y_count++] = { input, type, overrides };
+  }
+
+  ButtonMapping mapping = {};
+  size_t socd_x_count = 0;
+  ProfileSOCDInput socd_x[PROFILE_MAX_SOCD_INPUTS] = {};
+  size_t socd_y_count = 0;
+  ProfileSOCDInput socd_y[PROFILE_MAX_SOCD_INPUTS] = {};
+};
+
+// A profile compiled into a form whose cost doesn't depend on how it's configured: buttons are
+// remapped with one mask and shift per distinct distance between a physical input and the button
+// it's mapped to, and SOCD inputs are read from flat tables.
+struct ProfileProgram {
+  constexpr ProfileProgram() = default;
+
+  explicit constexpr ProfileProgram(const ProfileDescriptor& profile) {
+    const ButtonMapping& mapping = profile.mapping;
+
+    // In input_state_buttons order.
+    const uint8_t sources[INPUT_STATE_BUTTON_COUNT] = {
+      mapping.button_north, mapping.button_east,  mapping.button_south,  mapping.button_west,
+      mapping.button_l1,    mapping.button_l2,    mapping.button_l3,     mapping.button_r1,
+      mapping.button_r2,    mapping.button_r3,    mapping.button_select, mapping.button_start,
+      mapping.button_home,  mapping.button_touchpad,
+    };
+
+    for (size_t i = 0; i < INPUT_STATE_BUTTON_COUNT; ++i) {
+      if (sources[i] >= PL_GPIO_COUNT) {
+        continue;
+      }
+
+      int shift = static_cast<int>(i) - sources[i];
+      size_t step = 0;
+      while (step < step_count && steps[step].left - steps[step].right != shift) {
+        ++step;
+      }
+
+      if (step == step_count) {
+        ++step_count;
+        steps[step].left = shift > 0 ? shift : 0;
+        steps[step].right = shift < 0 ? -shift : 0;
+      }
+      steps[step].mask |= 1U << sources[i];
+    }
+
+    menu_button = mapping.button_menu;
+    for (size_t i = 0; i < profile.socd_x_count; ++i) {
+      const ProfileSOCDInput& input = profile.socd_x[i];
+      socd_x.add(input.input, input.button_type, input.overrides);
+    }
+    for (size_t i = 0; i < profile.socd_y_count; ++i) {
+      const ProfileSOCDInput& input = profile.socd_y[i];
+      socd_y.add(input.input, input.button_type, input.overrides);
+    }
+  }
+
+  // Remap a RawInputState mask into an input_state_buttons mask.
+  uint16_t buttons(uint32_t raw) const {
+    uint32_t result = 0;
+    for (size_t i = 0; i < step_count; ++i) {
+      result |= ((raw & steps[i].mask) << steps[i].left) >> steps[i].right;
+    }
+    return result;
+  }
+
+  struct Step {
+    uint32_t mask = 0;
+    uint8_t left = 0;
+    uint8_t right = 0;
+  };
+
+  size_t step_count = 0;
+  Step steps[INPUT_STATE_BUTTON_COUNT] = {};
+
+  uint8_t menu_button = 0xff;
+
+  SOCDAxisIndex socd_x;
+  SOCDAxisIndex socd_y;
 };
 
 static constexpr ButtonMapping base_mapping() {
@@ -46,143 +146,111 @@ static constexpr ButtonMapping default_mapping() {
   return result;
 }
 
-static size_t default_socd_x(span<SOCDInputs> out, const RawInputState* in) {
-  size_t i = 0;
-  out[i++] = { in->stick_left, button_history.stick_left.tick, SOCDButtonType::Negative };
-  out[i++] = { in->stick_right, button_history.stick_right.tick, SOCDButtonType::Positive };
-  return i;
-}
-
-static size_t default_socd_y(span<SOCDInputs> out, const RawInputState* in) {
-  size_t i = 0;
-  out[i++] = { in->stick_up, button_history.stick_up.tick, SOCDButtonType::Negative };
-  out[i++] = { in->stick_down, button_history.stick_down.tick, SOCDButtonType::Positive };
+static constexpr ProfileDescriptor default_profile() {
+  ProfileDescriptor result;
+  result.mapping = default_mapping();
+  result.add_x(RawInputState::stick_left_offset, SOCDButtonType::Negative);
+  result.add_x(RawInputState::stick_right_offset, SOCDButtonType::Positive);
+  result.add_y(RawInputState::stick_up_offset, SOCDButtonType::Negative);
+  result.add_y(RawInputState::stick_down_offset, SOCDButtonType::Positive);
 #if PL_GPIO_AVAILABLE(button_w)
-  out[i++] = { in->button_w, button_history.button_w.tick, SOCDButtonType::Negative };
+  result.add_y(RawInputState::button_w_offset, SOCDButtonType::Negative);
 #endif
-  return i;
+  return result;
 }
 
-static struct DefaultProfile : Profile {
-  const char* name() final { return "Default"; }
-
-  const ButtonMapping* button_mapping() final { return &mapping; }
-
-  size_t socd_x(span<SOCDInputs> out, const RawInputState* in) final {
-    return default_socd_x(out, in);
-  }
-
-  size_t socd_y(span<SOCDInputs> out, const RawInputState* in) final {
-    return default_socd_y(out, in);
-  }
-
-  static constexpr ButtonMapping mapping = default_mapping();
-} default_profile;
-
 #if defined(CONFIG_PASSINGLINK_DISPLAY)
-
-static size_t dashblock_socd_x(span<SOCDInputs> out, const RawInputState* in) {
-  size_t n = default_socd_x(out, in);
+static constexpr ProfileDescriptor dashblock_profile() {
+  ProfileDescriptor result = default_profile();
+  result.mapping = base_mapping();
 #if PL_GPIO_AVAILABLE(button_thumb_left)
-  out[n++] = { in->button_thumb_left, button_history.button_thumb_left.tick,
-               SOCDButtonType::Negative, true };
+  result.add_x(RawInputState::button_thumb_left_offset, SOCDButtonType::Negative, true);
+  result.add_y(RawInputState::button_thumb_left_offset, SOCDButtonType::Neutral, true);
 #endif
 #if PL_GPIO_AVAILABLE(button_thumb_right)
-  out[n++] = { in->button_thumb_right, button_history.button_thumb_right.tick,
-               SOCDButtonType::Positive, true };
-#endif
-  return n;
-}
-
-static size_t dashblock_socd_y(span<SOCDInputs> out, const RawInputState* in) {
-  size_t n = default_socd_y(out, in);
-#if PL_GPIO_AVAILABLE(button_thumb_left)
-  out[n++] = { in->button_thumb_left, button_history.button_thumb_left.tick,
-               SOCDButtonType::Neutral, true };
+  result.add_x(RawInputState::button_thumb_right_offset, SOCDButtonType::Positive, true);
+  result.add_y(RawInputState::button_thumb_right_offset, SOCDButtonType::Neutral, true);
 #endif
-#if PL_GPIO_AVAILABLE(button_thumb_right)
-  out[n++] = { in->button_thumb_right, button_history.button_thumb_right.tick,
-               SOCDButtonType::Neutral, true };
-#endif
-  return n;
+  return result;
 }
 
-static struct DashblockProfile : Profile {
-  const char* name() final { return "Dashblock"; }
-
-  const ButtonMapping* button_mapping() final { return &mapping; }
-
-  size_t socd_x(span<SOCDInputs> out, const RawInputState* in) final {
-    return dashblock_socd_x(out, in);
-  }
-
-  size_t socd_y(span<SOCDInputs> out, const RawInputState* in) final {
-    return dashblock_socd_y(out, in);
-  }
-
-  static constexpr ButtonMapping mapping = base_mapping();
-} dashblock_profile;
-
-static size_t tigerknee_socd_x(span<SOCDInputs> out, const RawInputState* in) {
-  size_t n = default_socd_x(out, in);
+static constexpr ProfileDescriptor tigerknee_profile() {
+  ProfileDescriptor result = default_profile();
+  result.mapping = base_mapping();
 #if PL_GPIO_AVAILABLE(button_thumb_left)
-  out[n++] = { in->button_thumb_left, button_history.button_thumb_left.tick,
-               SOCDButtonType::Negative, true };
+  result.add_x(RawInputState::button_thumb_left_offset, SOCDButtonType::Negative, true);
+  result.add_y(RawInputState::button_thumb_left_offset, SOCDButtonType::Negative, true);
 #endif
 #if PL_GPIO_AVAILABLE(button_thumb_right)
-  out[n++] = { in->button_thumb_right, button_history.button_thumb_right.tick,
-               SOCDButtonType::Positive, true };
+  result.add_x(RawInputState::button_thumb_right_offset, SOCDButtonType::Positive, true);
+  result.add_y(RawInputState::button_thumb_right_offset, SOCDButtonType::Negative, true);
 #endif
-  return n;
+  return result;
 }
+#endif  // defined(CONFIG_PASSINGLINK_DISPLAY)
 
-static size_t tigerknee_socd_y(span<SOCDInputs> out, const RawInputState* in) {
-  size_t n = default_socd_y(out, in);
-#if PL_GPIO_AVAILABLE(button_thumb_left)
-  out[n++] = { in->button_thumb_left, button_history.button_thumb_left.tick,
-               SOCDButtonType::Negative, true };
-#endif
-#if PL_GPIO_AVAILABLE(button_thumb_right)
-  out[n++] = { in->button_thumb_right, button_history.button_thumb_right.tick,
-               SOCDButtonType::Negative, true };
+// Built-in programs are separate constants so that they can be template arguments: see
+// CompiledProfile.
+static constexpr ProfileProgram default_program(default_profile());
+#if defined(CONFIG_PASSINGLINK_DISPLAY)
+static constexpr ProfileProgram dashblock_program(dashblock_profile());
+static constexpr ProfileProgram tigerknee_program(tigerknee_profile());
 #endif
-  return n;
-}
 
-static struct TigerKneeProfile : Profile {
-  const char* name() final { return "Tigerknee"; }
+struct BuiltinProfile {
+  const char* name;
+  const ProfileProgram* program;
+};
 
-  const ButtonMapping* button_mapping() final { return &mapping; }
+// Each of these is run as a CompiledProfile: see input_profile_run_builtin.
+static constexpr BuiltinProfile builtin_profiles[] = {
+  { "Default", &default_program },
+#if defined(CONFIG_PASSINGLINK_DISPLAY)
+  { "Dashblock", &dashblock_program },
+  { "Tigerknee", &tigerknee_program },
+#endif
+};
 
-  size_t socd_x(span<SOCDInputs> out, const RawInputState* in) final {
-    return tigerknee_socd_x(out, in);
-  }
+static constexpr size_t builtin_profile_count = ARRAY_SIZE(builtin_profiles);
 
-  size_t socd_y(span<SOCDInputs> out, const RawInputState* in) final {
-    return tigerknee_socd_y(out, in);
-  }
+#if defined(CONFIG_PASSINGLINK_INPUT_CUSTOM_PROFILES)
+struct CustomProfileSet {
+  size_t count;
+  char names[CUSTOM_PROFILE_COUNT][CUSTOM_PROFILE_NAME_LENGTH];
+  ProfileProgram programs[CUSTOM_PROFILE_COUNT];
+};
 
-  static constexpr ButtonMapping mapping = base_mapping();
-} tigerknee_profile;
-#endif  // defined(CONFIG_PASSINGLINK_DISPLAY)
+// The custom profiles are double buffered: they're compiled into the set that isn't published,
+// which is then published with a single store to custom_profile_set_idx, so that the report path
+// never sees a partially loaded set.
+static CustomProfileSet custom_profile_sets[2];
+static atomic_t custom_profile_set_idx;
 
-// TODO: Support custom profiles.
-#if defined(CONFIG_PASSINGLINK_DISPLAY)
-static const array<Profile*, 3> profiles = { &default_profile, &dashblock_profile,
-                                             &tigerknee_profile };
-#else
-static const array<Profile*, 1> profiles = { &default_profile };
+static const CustomProfileSet& custom_profile_set() {
+  return custom_profile_sets[atomic_get(&custom_profile_set_idx)];
+}
 #endif
 
 // TODO: Save active profile.
 static size_t active_profile_idx = 0;
 
 size_t input_profile_count() {
-  return profiles.size();
+#if defined(CONFIG_PASSINGLINK_INPUT_CUSTOM_PROFILES)
+  return builtin_profile_count + custom_profile_set().count;
+#else
+  return builtin_profile_count;
+#endif
 }
 
 const char* input_profile_get_name(size_t idx) {
-  return profiles[idx]->name();
+  if (idx < builtin_profile_count) {
+    return builtin_profiles[idx].name;
+  }
+#if defined(CONFIG_PASSINGLINK_INPUT_CUSTOM_PROFILES)
+  return custom_profile_set().names[idx - builtin_profile_count];
+#else
+  return nullptr;
+#endif
 }
 
 size_t input_profile_get_active() {
@@ -190,41 +258,59 @@ size_t input_profile_get_active() {
 }
 
 void input_profile_activate(size_t idx) {
+  if (idx >= input_profile_count()) {
+    return;
+  }
+
   active_profile_idx = idx;
 }
 
-static Profile* active_profile() {
-  return profiles[active_profile_idx];
-}
+// A profile whose program is only known at runtime (i.e. a custom one).
+struct RuntimeProfile {
+  uint8_t menu_button() const { return program->menu_button; }
+  uint16_t buttons(uint32_t raw) const { return program->buttons(raw); }
 
-#if defined(CONFIG_PASSINGLINK_DISPLAY)
-static SOCDInputs socd_buf[32];
-#else
-static SOCDInputs socd_buf[2];
-#endif
+  StickOutput::Axis socd_x(SOCDType type, InputPipeline* pipeline, uint32_t raw) const {
+    return input_socd_resolve(type, program->socd_x, raw, pipeline->button_history);
+  }
 
-static StickOutput::Axis input_profile_socd_x(Profile* profile, const RawInputState* in) {
-  size_t n = profile->socd_x(socd_buf, in);
-  span<SOCDInputs> inputs(socd_buf, n);
-  return input_socd_parse(input_socd_get_x_type(), inputs);
-}
+  StickOutput::Axis socd_y(SOCDType type, InputPipeline* pipeline, uint32_t raw) const {
+    return input_socd_resolve(type, program->socd_y, raw, pipeline->button_history);
+  }
 
-static StickOutput::Axis input_profile_socd_y(Profile* profile, const RawInputState* in) {
-  size_t n = profile->socd_y(socd_buf, in);
-  span<SOCDInputs> inputs(socd_buf, n);
-  return input_socd_parse(input_socd_get_y_type(), inputs);
-}
+  const ProfileProgram* program;
+};
 
-static bool get_bit(const void* ptr, size_t idx) {
-  auto p = static_cast<const char*>(ptr);
-  char byte = p[idx / 8];
-  return byte & 1 << (idx % 8);
-}
+// A built-in profile, with its program known at compile time: the remap steps and SOCD tables
+// are unrolled into straight-line code with constant masks, shifts and offsets.
+template <const ProfileProgram& Program>
+struct CompiledProfile {
+  static constexpr uint8_t menu_button() { return Program.menu_button; }
+
+  template <size_t I = 0>
+  static ALWAYS_INLINE uint16_t buttons(uint32_t raw) {
+    if constexpr (I == Program.step_count) {
+      return 0;
+    } else {
+      constexpr ProfileProgram::Step step = Program.steps[I];
+      return (((raw & step.mask) << step.left) >> step.right) | buttons<I + 1>(raw);
+    }
+  }
+
+  static StickOutput::Axis socd_x(SOCDType type, InputPipeline* pipeline, uint32_t raw) {
+    return input_socd_resolve(type, Program.socd_x, raw, pipeline->button_history);
+  }
+
+  static StickOutput::Axis socd_y(SOCDType type, InputPipeline* pipeline, uint32_t raw) {
+    return input_socd_resolve(type, Program.socd_y, raw, pipeline->button_history);
+  }
+};
 
 #if defined(CONFIG_PASSINGLINK_DISPLAY)
-bool input_profile_parse_menu(const RawInputState* in, ButtonHistory::Button* menu_button,
-                              StickOutput stick, uint64_t current_tick) {
-  static bool menu_opened = false;
+bool input_profile_parse_menu(InputPipeline* pipeline, const RawInputState* in,
+                              ButtonHistory::Button* menu_button, StickOutput stick,
+                              uint64_t current_tick) {
+  bool& menu_opened = pipeline->menu_opened;
 
   if (!menu_button->state) {
     if (menu_opened) {
@@ -237,7 +323,7 @@ bool input_profile_parse_menu(const RawInputState* in, ButtonHistory::Button* me
   if (optional<uint64_t> lock_tick = input_get_lock_tick()) {
     // TODO: Make timeout configurable.
     // TODO: Display progress bar.
-    if (current_tick - menu_button->tick < k_ms_to_ticks_ceil64(2000)) {
+    if (current_tick - menu_button->tick < k_ms_to_cyc_ceil64(2000)) {
       return false;
     } else if (*lock_tick < menu_button->tick) {
       if (!menu_opened) {
@@ -308,47 +394,30 @@ static uint8_t stick_scale(int sign) {
   }
 }
 
-static StickOutput input_socd(Profile* profile, const RawInputState* in) {
-  return StickOutput {
-    .x = input_profile_socd_x(profile, in),
-    .y = input_profile_socd_y(profile, in),
-  };
-}
-
-void input_profile_parse(InputState* out, const RawInputState* in, uint64_t current_tick) {
-  Profile* profile = active_profile();
-  const ButtonMapping* mapping = profile->button_mapping();
+template <typename Profile>
+static ALWAYS_INLINE void input_profile_run(const Profile& profile, SOCDType x_type,
+                                           SOCDType y_type, InputPipeline* pipeline,
+                                           InputState* out, const RawInputState* in,
+                                           uint64_t current_tick) {
+  uint32_t raw = raw_input_state_to_mask(*in);
 
-  StickOutput stick_output = input_socd(profile, in);
+  StickOutput stick_output = {
+    .x = profile.socd_x(x_type, pipeline, raw),
+    .y = profile.socd_y(y_type, pipeline, raw),
+  };
+  TRACE(SOCDResolve, (stick_output.x.value + 1) | (stick_output.y.value + 1) << 2);
 
 #if defined(CONFIG_PASSINGLINK_DISPLAY)
-  if (mapping->button_menu != 0xff) {
-    if (input_profile_parse_menu(in, &button_history.values[mapping->button_menu], stick_output,
-                                 current_tick)) {
+  uint8_t menu_idx = profile.menu_button();
+  if (menu_idx < PL_GPIO_COUNT) {
+    ButtonHistory::Button* menu_button = &pipeline->button_history.values[menu_idx];
+    if (input_profile_parse_menu(pipeline, in, menu_button, stick_output, current_tick)) {
       return;
     }
   }
 #endif
 
-#define BUTTONS()       \
-  BUTTON(button_north)  \
-  BUTTON(button_east)   \
-  BUTTON(button_south)  \
-  BUTTON(button_west)   \
-  BUTTON(button_l1)     \
-  BUTTON(button_l2)     \
-  BUTTON(button_l3)     \
-  BUTTON(button_r1)     \
-  BUTTON(button_r2)     \
-  BUTTON(button_r3)     \
-  BUTTON(button_select) \
-  BUTTON(button_start)  \
-  BUTTON(button_home)   \
-  BUTTON(button_touchpad)
-#define BUTTON(name) out->name = (mapping->name == 0xff) ? 0 : get_bit(in, mapping->name);
-  BUTTONS();
-#undef BUTTON
-#undef BUTTONS
+  input_state_set_buttons(out, profile.buttons(raw));
 
   OutputMode output_mode = input_get_output_mode();
   switch (output_mode) {
@@ -375,4 +444,210 @@ void input_profile_parse(InputState* out, const RawInputState* in, uint64_t curr
   }
 }
 
+// Run the CompiledProfile of the builtin profile at idx, if there is one. The dispatch is generated
+// from builtin_profiles, so adding or reordering profiles can't route them to the wrong program.
+template <size_t I = 0>
+static ALWAYS_INLINE bool input_profile_run_builtin(size_t idx, SOCDType x_type, SOCDType y_type,
+                                                    InputPipeline* pipeline, InputState* out,
+                                                    const RawInputState* in,
+                                                    uint64_t current_tick) {
+  if constexpr (I == builtin_profile_count) {
+    return false;
+  } else {
+    if (idx == I) {
+      input_profile_run(CompiledProfile<*builtin_profiles[I].program>(), x_type, y_type, pipeline,
+                        out, in, current_tick);
+      return true;
+    }
+    return input_profile_run_builtin<I + 1>(idx, x_type, y_type, pipeline, out, in,
+                                            current_tick);
+  }
+}
+
+void input_profile_parse(size_t profile_idx, SOCDType x_type, SOCDType y_type,
+                         InputPipeline* pipeline, InputState* out, const RawInputState* in,
+                         uint64_t current_tick) {
+  if (input_profile_run_builtin(profile_idx, x_type, y_type, pipeline, out, in, current_tick)) {
+    return;
+  }
+
+#if defined(CONFIG_PASSINGLINK_INPUT_CUSTOM_PROFILES)
+  const ProfileProgram* program = &custom_profile_set().programs[profile_idx - builtin_profile_count];
+  input_profile_run(RuntimeProfile { program }, x_type, y_type, pipeline, out, in, current_tick);
+#endif
+}
+
+void input_profile_parse(InputPipeline* pipeline, InputState* out, const RawInputState* in,
+                         uint64_t current_tick) {
+  input_profile_parse(active_profile_idx, input_socd_get_x_type(), input_socd_get_y_type(),
+                      pipeline, out, in, current_tick);
+}
+
+#if defined(CONFIG_PASSINGLINK_INPUT_CUSTOM_PROFILES)
+// Custom profiles are uploaded into a temporary, and only replace the stored ones when flushed.
+static CustomProfileData custom_profile_buffer;
+
+static_assert(sizeof(CustomProfileData) % 8 == 0, "must be a multiple of the flash write size");
+
+static bool input_profile_validate_socd(const CustomProfileSOCDInput* inputs, size_t count) {
+  if (count > PROFILE_MAX_SOCD_INPUTS) {
+    return false;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (inputs[i].input >= PL_GPIO_COUNT || inputs[i].button_type < -1 ||
+        inputs[i].button_type > 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void input_profile_add_socd(ProfileDescriptor* profile, const CustomProfileSOCDInput& input,
+                                   bool x) {
+  SOCDButtonType type = static_cast<SOCDButtonType>(input.button_type);
+  if (x) {
+    profile->add_x(input.input, type, input.overrides);
+  } else {
+    profile->add_y(input.input, type, input.overrides);
+  }
+}
+
+// Compile the custom profiles in data, replacing the current ones. Loads must not overlap.
+static void input_profile_load_custom(const CustomProfileData* data) {
+  // Don't leave a profile that's being replaced active.
+  if (active_profile_idx >= builtin_profile_count) {
+    input_profile_activate(0);
+  }
+
+  atomic_val_t next_idx = !atomic_get(&custom_profile_set_idx);
+  CustomProfileSet& next = custom_profile_sets[next_idx];
+  next.count = 0;
+
+  if (data->version != CustomProfileVersion::V1) {
+    LOG_INF("no custom profiles found");
+    atomic_set(&custom_profile_set_idx, next_idx);
+    return;
+  }
+
+  for (const CustomProfile& custom : data->profiles) {
+    if (custom.name[0] == '\0') {
+      continue;
+    }
+
+    if (strnlen(custom.name, sizeof(custom.name)) == sizeof(custom.name) ||
+        !input_profile_validate_socd(custom.socd_x, custom.socd_x_count) ||
+        !input_profile_validate_socd(custom.socd_y, custom.socd_y_count)) {
+      LOG_ERR("invalid custom profile, skipping");
+      continue;
+    }
+
+    ProfileDescriptor profile;
+    memcpy(&profile.mapping, custom.mapping, sizeof(profile.mapping));
+    for (size_t i = 0; i < custom.socd_x_count; ++i) {
+      input_profile_add_socd(&profile, custom.socd_x[i], true);
+    }
+    for (size_t i = 0; i < custom.socd_y_count; ++i) {
+      input_profile_add_socd(&profile, custom.socd_y[i], false);
+    }
+
+    memcpy(next.names[next.count], custom.name, sizeof(custom.name));
+    next.programs[next.count] = ProfileProgram(profile);
+    ++next.count;
+  }
+
+  atomic_set(&custom_profile_set_idx, next_idx);
+  LOG_INF("loaded %zu custom profiles", next.count);
+}
+
+// Set while custom_profile_buffer is being flushed, during which it can't be written to.
+static atomic_t custom_profile_flushing;
+
+bool input_profile_write(const void* data, size_t length, size_t offset) {
+  if (atomic_get(&custom_profile_flushing)) {
+    LOG_ERR("input_profile_write: flush in progress, aborting");
+    return false;
+  }
+
+  if (length + offset > sizeof(custom_profile_buffer)) {
+    LOG_ERR("input_profile_write: overflow, aborting");
+    return false;
+  }
+
+  memcpy(reinterpret_cast<char*>(&custom_profile_buffer) + offset, data, length);
+  return true;
+}
+
+#if FLASH_AREA_LABEL_EXISTS(storage)
+// The length of the start of the flash area, rounded up to a whole number of pages.
+static optional<size_t> input_profile_erase_length(const struct flash_area* flash_area,
+                                                   size_t length) {
+  struct flash_pages_info info;
+  off_t last_byte = flash_area->fa_off + length - 1;
+  if (flash_get_page_info_by_offs(flash_area_get_device(flash_area), last_byte, &info) != 0) {
+    return {};
+  }
+  return info.start_offset + info.size - flash_area->fa_off;
+}
+
+static void input_profile_flush_impl(struct k_work*) {
+  const struct flash_area* flash_area;
+  if (flash_area_open(FLASH_AREA_ID(storage), &flash_area) != 0) {
+    LOG_ERR("input_profile_flush: failed to open flash area");
+    atomic_set(&custom_profile_flushing, 0);
+    return;
+  }
+
+  // Only erase the pages that the custom profiles are stored in.
+  optional<size_t> erase_length =
+    input_profile_erase_length(flash_area, sizeof(custom_profile_buffer));
+  if (!erase_length) {
+    LOG_ERR("input_profile_flush: failed to get flash page layout");
+  } else if (flash_area_erase(flash_area, 0, *erase_length) != 0) {
+    LOG_ERR("input_profile_flush: failed to erase flash area");
+  } else if (flash_area_write(flash_area, 0, &custom_profile_buffer,
+                              sizeof(custom_profile_buffer)) != 0) {
+    LOG_ERR("input_profile_flush: failed to write flash area");
+  } else {
+    input_profile_load_custom(&custom_profile_buffer);
+  }
+
+  atomic_set(&custom_profile_flushing, 0);
+}
+
+K_WORK_DEFINE(input_profile_flush_work, input_profile_flush_impl);
+
+bool input_profile_flush() {
+  // Erasing flash takes far too long to do in the control transfer that requested the flush.
+  if (!atomic_cas(&custom_profile_flushing, 0, 1)) {
+    LOG_ERR("input_profile_flush: flush already in progress");
+    return false;
+  }
+
+  k_work_submit(&input_profile_flush_work);
+  return true;
+}
+
+void input_profile_init() {
+  const struct flash_area* flash_area;
+  if (flash_area_open(FLASH_AREA_ID(storage), &flash_area) != 0 ||
+      flash_area_read(flash_area, 0, &custom_profile_buffer, sizeof(custom_profile_buffer)) != 0) {
+    LOG_ERR("failed to read custom profiles");
+    return;
+  }
+
+  input_profile_load_custom(&custom_profile_buffer);
+}
+#else
+bool input_profile_flush() {
+  LOG_ERR("no storage partition defined");
+  return false;
+}
+
+void input_profile_init() {
+  LOG_WRN("no storage partition defined, custom profiles are unavailable");
+}
+#endif
+#else
 void input_profile_init() {}
+#endif
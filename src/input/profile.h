@@ -1,5 +1,6 @@
 #pragma once
 
+#include "input/pipeline.h"
 #include "input/socd.h"
 
 void input_profile_init();
@@ -10,4 +11,20 @@ const char* input_profile_get_name(size_t idx);
 size_t input_profile_get_active();
 void input_profile_activate(size_t idx);
 
-void input_profile_parse(InputState* out, const RawInputState* in, uint64_t current_tick);
+// Parse with the active profile and SOCD types.
+void input_profile_parse(InputPipeline* pipeline, InputState* out, const RawInputState* in,
+                         uint64_t current_tick);
+
+// Parse with the given profile and SOCD types, without touching the active ones.
+void input_profile_parse(size_t profile_idx, SOCDType x_type, SOCDType y_type,
+                         InputPipeline* pipeline, InputState* out, const RawInputState* in,
+                         uint64_t current_tick);
+
+#if defined(CONFIG_PASSINGLINK_INPUT_CUSTOM_PROFILES)
+// Write part of CustomProfileData into a temporary.
+bool input_profile_write(const void* data, size_t length, size_t offset);
+
+// Save the temporary to flash, and replace the custom profiles with it. The flush happens
+// asynchronously, and the temporary can't be written to until it's done.
+bool input_profile_flush();
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Custom profiles are stored at the start of the storage partition on flash, and uploaded with
+// the WriteProfiles and FlushProfiles feature reports.
+enum class CustomProfileVersion : uint32_t {
+  V1 = 0x1209214e,
+};
+
+static constexpr size_t CUSTOM_PROFILE_COUNT = 4;
+static constexpr size_t CUSTOM_PROFILE_NAME_LENGTH = 16;
+
+// Maximum number of inputs that can affect each stick axis.
+static constexpr size_t PROFILE_MAX_SOCD_INPUTS = 8;
+
+struct __attribute__((packed)) CustomProfileSOCDInput {
+  // RawInputState offset of the input.
+  uint8_t input;
+
+  // SOCDButtonType: -1 for up/left, 1 for down/right, 0 for neither.
+  int8_t button_type;
+
+  // Whether the input takes priority over inputs without overrides set.
+  uint8_t overrides;
+};
+
+struct __attribute__((packed)) CustomProfile {
+  // NUL-terminated. Profiles with an empty name are unused.
+  char name[CUSTOM_PROFILE_NAME_LENGTH];
+
+  // ButtonMapping: for each RawInputState input, the offset of the physical input that's
+  // interpreted as it, or 0xFF for none.
+  uint8_t mapping[27];
+
+  uint8_t socd_x_count;
+  uint8_t socd_y_count;
+  CustomProfileSOCDInput socd_x[PROFILE_MAX_SOCD_INPUTS];
+  CustomProfileSOCDInput socd_y[PROFILE_MAX_SOCD_INPUTS];
+};
+
+struct __attribute__((packed)) CustomProfileData {
+  CustomProfileVersion version;
+  CustomProfile profiles[CUSTOM_PROFILE_COUNT];
+};
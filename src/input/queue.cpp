@@ -4,108 +4,524 @@
 
 #include <logging/log.h>
 
+#include "input/clock.h"
+#include "input/record.h"
+
 #define LOG_LEVEL LOG_LEVEL_INF
 LOG_MODULE_REGISTER(queue);
 
 #if defined(CONFIG_PASSINGLINK_INPUT_QUEUE)
 
-static constexpr size_t queue_storage_size = 1024;
-static size_t queue_storage_last_avail = 0;
-static Bitmap<queue_storage_size> queue_storage_bitmap;
-static InputQueue queue_storage[queue_storage_size];
+// Queued inputs are stored as a byte stream of entries, each of which is the number of inputs that
+// changed from the previous entry, the RawInputState offsets of those inputs, and the delay in
+// frames as a little-endian base-128 varint (one byte for typical delays).
+//
+// Streams are stored in a chain of fixed-size blocks, which are allocated from a free list.
+static constexpr size_t queue_block_size = 32;
+static constexpr size_t queue_block_count = 128;
+static constexpr uint16_t queue_block_none = UINT16_MAX;
+
+struct InputQueueBlock {
+  uint16_t next;
+  uint8_t data[queue_block_size - sizeof(uint16_t)];
+};
+
+static_assert(sizeof(InputQueueBlock) == queue_block_size);
+
+static InputQueueBlock queue_blocks[queue_block_count];
+
+// Freed blocks are kept on a list threaded through InputQueueBlock::next. Blocks that have never
+// been allocated are handed out in order from queue_blocks_unused, so that the free list doesn't
+// need to be initialized.
+static uint16_t queue_block_free_list = queue_block_none;
+static size_t queue_blocks_unused = 0;
+
+static size_t queue_blocks_in_use;
+static size_t queue_blocks_high_water;
+static size_t queue_alloc_failures;
+
+struct InputQueueCursor {
+  uint16_t block;
+  uint8_t offset;
+
+  bool operator==(const InputQueueCursor& rhs) const {
+    return block == rhs.block && offset == rhs.offset;
+  }
+};
+
+// The InputQueue API is a facade over the byte stream: a macro only ever has two nodes, its head
+// (which identifies the macro) and its tail (which is being filled in by the caller). A node's
+// contents are encoded when something is appended to it, or when the macro is activated.
+// Ownership of a macro. Only the owner of a macro may touch it, except for its state and consume
+// flag, which are used to hand it between producers and input_queue_get_state without locking.
+enum class InputQueueMacroState : atomic_val_t {
+  // Not allocated.
+  Free,
+
+  // Owned by a producer, which can append to it and activate it.
+  Owned,
+
+  // Requested for playback, or being played back, by input_queue_get_state.
+  Active,
+
+  // Finished playing, and waiting for a producer to reclaim its storage.
+  Done,
+};
+
+struct InputQueueMacro {
+  atomic_t state;
+
+  // Whether the macro should be freed once it's done playing.
+  atomic_t consume;
+
+  // Whether the last node has been encoded: nothing can be appended afterwards.
+  bool sealed;
+
+  InputQueue head;
+  InputQueue tail;
+
+  // The node that will be encoded next.
+  InputQueue* pending;
 
-static RawInputState queue_input;
+  uint16_t first_block;
+  InputQueueCursor end;
+  uint32_t last_state;
+};
 
-static InputQueue* queue_next;
-static InputQueue* queue_next_free_head;
+static constexpr size_t queue_macro_count = CONFIG_PASSINGLINK_INPUT_QUEUE_MACRO_COUNT;
+static InputQueueMacro queue_macros[queue_macro_count];
 
-static int64_t queue_next_tick;
+static InputQueueMacroState queue_macro_state(InputQueueMacro* macro) {
+  return static_cast<InputQueueMacroState>(atomic_get(&macro->state));
+}
+
+static void queue_macro_set_state(InputQueueMacro* macro, InputQueueMacroState state) {
+  atomic_set(&macro->state, static_cast<atomic_val_t>(state));
+}
+
+static bool queue_macro_cas_state(InputQueueMacro* macro, InputQueueMacroState expected,
+                                  InputQueueMacroState state) {
+  return atomic_cas(&macro->state, static_cast<atomic_val_t>(expected),
+                    static_cast<atomic_val_t>(state));
+}
+
+// Playback requests from producers to input_queue_get_state: 0 if there's nothing pending, the
+// index of the requested macro plus one, or queue_request_stop.
+static constexpr atomic_val_t queue_request_stop = -1;
+static atomic_t queue_request;
+
+// The inputs that playback currently outputs, as a RawInputState mask with queue_output_valid
+// set, or 0 if nothing is playing. input_queue_get_state only ever reads this, so that generating
+// reports (from the USB work queue, the BT thread and the shell alike) never waits for playback.
+static constexpr uint32_t queue_output_valid = BIT(31);
+static_assert(PL_GPIO_COUNT < 32);
+static atomic_t queue_output;
+
+// Everything below is only touched by the playback owner, queue_advance, which is called once per
+// frame: from the start of frame interrupt with CONFIG_PASSINGLINK_INPUT_QUEUE_FRAME_CLOCK, and
+// from queue_timer otherwise, or when start of frame events stop.
+
+// The macro being played back, and where we are in it.
+static InputQueueMacro* queue_active;
+static InputQueueCursor queue_cursor;
+static uint32_t queue_state;
+
+static uint32_t queue_next_frame;
+
+static void queue_advance();
+
+#if defined(CONFIG_PASSINGLINK_INPUT_QUEUE_FRAME_CLOCK)
+static atomic_t queue_frames;
+static atomic_t queue_last_frame_cycle;
+
+void input_queue_frame() {
+  atomic_set(&queue_last_frame_cycle, input_clock_sample());
+  atomic_inc(&queue_frames);
+  queue_advance();
+}
+
+static uint32_t queue_current_frame() {
+  return atomic_get(&queue_frames);
+}
+
+// Start of frame events stop while USB is suspended, and never start when output is over
+// Bluetooth: if there hasn't been one for more than a frame (plus some slack for jitter), the
+// timer counts milliseconds of uptime as frames instead.
+static void queue_timer_expired(struct k_timer*) {
+  uint32_t since_frame = input_clock_sample() - atomic_get(&queue_last_frame_cycle);
+  if (since_frame > k_us_to_cyc_ceil32(1500)) {
+    atomic_inc(&queue_frames);
+    queue_advance();
+  }
+}
+#else
+void input_queue_frame() {}
+
+// Without USB frames, a frame is a millisecond of the input clock, and a timer that only runs
+// while there's something to play advances playback.
+static uint32_t queue_current_frame() {
+  return k_cyc_to_ms_floor64(input_clock_now());
+}
+
+static void queue_timer_expired(struct k_timer*) {
+  queue_advance();
+}
+#endif
+
+K_TIMER_DEFINE(queue_timer, queue_timer_expired, nullptr);
+
+static void queue_start() {
+  k_timer_start(&queue_timer, K_NO_WAIT, K_MSEC(1));
+}
+
+static void queue_stop() {
+  k_timer_stop(&queue_timer);
+}
+
+// Building macros and reclaiming their storage is done by producers, which are all threads: they
+// share the block allocator under a mutex, which playback never takes.
+K_MUTEX_DEFINE(queue_alloc_mutex);
+
+struct ScopedQueueAllocLock {
+  ScopedQueueAllocLock() { k_mutex_lock(&queue_alloc_mutex, K_FOREVER); }
+  ~ScopedQueueAllocLock() { k_mutex_unlock(&queue_alloc_mutex); }
+
+  ScopedQueueAllocLock(const ScopedQueueAllocLock& copy) = delete;
+  ScopedQueueAllocLock(ScopedQueueAllocLock&& move) = delete;
+};
+
+static uint16_t queue_block_alloc() {
+  uint16_t result;
+  if (queue_block_free_list != queue_block_none) {
+    result = queue_block_free_list;
+    queue_block_free_list = queue_blocks[result].next;
+  } else if (queue_blocks_unused < queue_block_count) {
+    result = queue_blocks_unused++;
+  } else {
+    ++queue_alloc_failures;
+    return queue_block_none;
+  }
+
+  queue_blocks[result].next = queue_block_none;
+  queue_blocks_high_water = max(queue_blocks_high_water, ++queue_blocks_in_use);
+  return result;
+}
+
+static bool queue_write_byte(InputQueueMacro* macro, uint8_t value) {
+  InputQueueCursor& end = macro->end;
+  if (end.offset == sizeof(InputQueueBlock::data)) {
+    uint16_t block = queue_block_alloc();
+    if (block == queue_block_none) {
+      return false;
+    }
+
+    queue_blocks[end.block].next = block;
+    end.block = block;
+    end.offset = 0;
+  }
+
+  queue_blocks[end.block].data[end.offset++] = value;
+  return true;
+}
+
+static uint8_t queue_read_byte(InputQueueCursor* cursor) {
+  if (cursor->offset == sizeof(InputQueueBlock::data)) {
+    cursor->block = queue_blocks[cursor->block].next;
+    cursor->offset = 0;
+  }
+
+  return queue_blocks[cursor->block].data[cursor->offset++];
+}
+
+static bool queue_encode(InputQueueMacro* macro, const InputQueue* node) {
+  uint32_t state = raw_input_state_to_mask(node->state);
+  uint32_t changed = state ^ macro->last_state;
+  macro->last_state = state;
+
+  if (!queue_write_byte(macro, __builtin_popcount(changed))) {
+    return false;
+  }
+
+  while (changed) {
+    uint8_t offset = __builtin_ctz(changed);
+    changed &= changed - 1;
+    if (!queue_write_byte(macro, offset)) {
+      return false;
+    }
+  }
+
+  uint32_t delay = node->delay;
+  while (delay >= 0x80) {
+    if (!queue_write_byte(macro, (delay & 0x7F) | 0x80)) {
+      return false;
+    }
+    delay >>= 7;
+  }
+  return queue_write_byte(macro, delay);
+}
+
+static bool queue_seal(InputQueueMacro* macro) {
+  if (macro->sealed) {
+    return true;
+  }
+
+  // The delay after the last entry is never waited for.
+  InputQueue* last = macro->pending;
+  last->delay = 0;
+  if (!queue_encode(macro, last)) {
+    return false;
+  }
+
+  macro->sealed = true;
+  return true;
+}
+
+// Hand a macro back from playback. Called by whoever owns a request or an active macro.
+static void queue_macro_finish(InputQueueMacro* macro) {
+  if (atomic_get(&macro->consume)) {
+    queue_macro_set_state(macro, InputQueueMacroState::Done);
+    return;
+  }
+
+  // input_queue_free might have set consume after we checked it: if so, it's up to us or it to
+  // mark the macro as done, whichever gets there first.
+  queue_macro_set_state(macro, InputQueueMacroState::Owned);
+  if (atomic_get(&macro->consume)) {
+    queue_macro_cas_state(macro, InputQueueMacroState::Owned, InputQueueMacroState::Done);
+  }
+}
+
+static InputQueueMacro* queue_request_macro(atomic_val_t request) {
+  if (request <= 0) {
+    return nullptr;
+  }
+  return &queue_macros[request - 1];
+}
+
+// Return the storage of done macros to the free list. Must be called with queue_alloc_mutex held.
+static void queue_reclaim() {
+  for (InputQueueMacro& macro : queue_macros) {
+    if (queue_macro_state(&macro) != InputQueueMacroState::Done) {
+      continue;
+    }
+
+    uint16_t block = macro.first_block;
+    while (block != queue_block_none) {
+      uint16_t next = queue_blocks[block].next;
+      queue_blocks[block].next = queue_block_free_list;
+      queue_block_free_list = block;
+      --queue_blocks_in_use;
+      block = next;
+    }
+
+    queue_macro_set_state(&macro, InputQueueMacroState::Free);
+  }
+}
 
 InputQueue* input_queue_alloc() {
-  ScopedIRQLock lock;
-  InputQueue* result = nullptr;
-  for (size_t i = queue_storage_last_avail; i < queue_storage_size; ++i) {
-    auto bit = queue_storage_bitmap[i];
-    if (!bit) {
-      bit = true;
-      queue_storage_last_avail = i + 1;
-      result = &queue_storage[i];
-      result->next = nullptr;
-      break;
+  ScopedQueueAllocLock lock;
+  queue_reclaim();
+  for (InputQueueMacro& macro : queue_macros) {
+    if (queue_macro_state(&macro) != InputQueueMacroState::Free) {
+      continue;
     }
+
+    uint16_t block = queue_block_alloc();
+    if (block == queue_block_none) {
+      return nullptr;
+    }
+
+    queue_macro_set_state(&macro, InputQueueMacroState::Owned);
+    atomic_set(&macro.consume, false);
+    macro.sealed = false;
+    macro.head.macro = &macro;
+    macro.tail.macro = &macro;
+    macro.pending = &macro.head;
+    macro.first_block = block;
+    macro.end = {.block = block, .offset = 0};
+    macro.last_state = 0;
+    return &macro.head;
   }
 
-  // TODO: Handle allocation failure.
-  return result;
+  ++queue_alloc_failures;
+  return nullptr;
 }
 
 InputQueue* input_queue_append(InputQueue* head) {
-  InputQueue* tail = input_queue_alloc();
-  if (!tail) {
+  ScopedQueueAllocLock lock;
+  InputQueueMacro* macro = head->macro;
+  if (macro->sealed || head != macro->pending) {
+    LOG_ERR("attempted to append to a node that isn't the end of the queue");
+    return nullptr;
+  }
+
+  if (!queue_encode(macro, head)) {
     return nullptr;
   }
 
-  head->next = tail;
-  tail->next = nullptr;
-  return tail;
+  macro->pending = &macro->tail;
+  return &macro->tail;
 }
 
 void input_queue_free(InputQueue* p) {
   if (!p) return;
 
-  ScopedIRQLock lock;
+  InputQueueMacro* macro = p->macro;
+  assert(macro >= queue_macros && macro < queue_macros + queue_macro_count);
+  assert(queue_macro_state(macro) != InputQueueMacroState::Free);
 
-  do {
-    ptrdiff_t offset = p - queue_storage;
-    assert(offset >= 0);
-    assert(static_cast<size_t>(offset) < queue_storage_size);
-    p = p->next;
+  // If the macro is being played back, it gets freed when it's done.
+  atomic_set(&macro->consume, true);
 
-    queue_storage_bitmap[offset] = false;
-    if (static_cast<size_t>(offset) < queue_storage_last_avail) {
-      queue_storage_last_avail = offset;
-    }
-  } while (p);
+  // If it was requested but playback hasn't picked it up yet, take the request back.
+  atomic_val_t request = macro - queue_macros + 1;
+  if (atomic_cas(&queue_request, request, 0)) {
+    queue_macro_set_state(macro, InputQueueMacroState::Done);
+  }
+
+  queue_macro_cas_state(macro, InputQueueMacroState::Owned, InputQueueMacroState::Done);
+
+  ScopedQueueAllocLock lock;
+  queue_reclaim();
 }
 
-optional<RawInputState> input_queue_get_state() {
-  ScopedIRQLock lock;
+// Read without locking, so that it can be called from any context: the counters are only
+// approximately consistent with each other, and macros that finished playing count as in use until
+// the next allocation or free reclaims them.
+InputQueueStats input_queue_get_stats() {
+  return {
+    .capacity = queue_block_count * queue_block_size,
+    .in_use = queue_blocks_in_use * queue_block_size,
+    .high_water = queue_blocks_high_water * queue_block_size,
+    .alloc_failures = queue_alloc_failures,
+  };
+}
+
+// Pick up a playback request from a producer, if there is one.
+static void queue_take_request() {
+  atomic_val_t request = atomic_set(&queue_request, 0);
+  if (request == 0) {
+    return;
+  }
+
+  InputQueueMacro* macro = queue_request_macro(request);
+  if (queue_active && queue_active != macro) {
+    queue_macro_finish(queue_active);
+  }
+
+  queue_active = macro;
+  if (macro) {
+    queue_cursor = {.block = macro->first_block, .offset = 0};
+    queue_state = 0;
+    queue_next_frame = queue_current_frame();
+  }
+}
 
-  if (queue_next) {
-    if (queue_next_tick < k_uptime_ticks()) {
-      queue_input = queue_next->state;
+// The start of frame interrupt and queue_timer can preempt each other when they both advance
+// playback, so it's guarded by a flag: whichever gets here second skips its turn, and the frame it
+// counted is caught up with on the next one.
+static atomic_t queue_advancing;
 
-      // TODO: k_timeout_t is supposed to be an opaque struct.
-      queue_next_tick += queue_next->delay.ticks;
+static void queue_advance_owned();
 
-      InputQueue* prev = queue_next;
-      queue_next = queue_next->next;
+static void queue_advance() {
+  if (!atomic_cas(&queue_advancing, 0, 1)) {
+    return;
+  }
+
+  queue_advance_owned();
+  atomic_set(&queue_advancing, 0);
+}
 
-      if (!queue_next) {
-        input_queue_free(queue_next_free_head);
-        queue_next_free_head = nullptr;
+static void queue_advance_owned() {
+  queue_take_request();
+  if (!queue_active) {
+    atomic_set(&queue_output, 0);
+    if (atomic_get(&queue_request) == 0) {
+      // Producers are threads, so they can't post a request between the check and stopping: if
+      // they post one afterwards, they restart the clock themselves.
+      queue_stop();
+    }
+    return;
+  }
+
+  if (static_cast<int32_t>(queue_current_frame() - queue_next_frame) >= 0) {
+    size_t changed = queue_read_byte(&queue_cursor);
+    for (size_t i = 0; i < changed; ++i) {
+      queue_state ^= 1U << queue_read_byte(&queue_cursor);
+    }
+
+    uint32_t delay = 0;
+    for (size_t shift = 0;; shift += 7) {
+      uint8_t byte = queue_read_byte(&queue_cursor);
+      delay |= static_cast<uint32_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        break;
       }
     }
-    return queue_input;
+
+    atomic_set(&queue_output, queue_state | queue_output_valid);
+    queue_next_frame += delay;
+
+    // The last entry is output for a single frame.
+    if (queue_cursor == queue_active->end) {
+      queue_macro_finish(queue_active);
+      queue_active = nullptr;
+    }
   }
-  return {};
+}
+
+optional<RawInputState> input_queue_get_state() {
+#if defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+  if (auto input = input_record_replay_get_state()) {
+    return input;
+  }
+#endif
+
+  uint32_t output = atomic_get(&queue_output);
+  if (!(output & queue_output_valid)) {
+    return {};
+  }
+  return raw_input_state_from_mask(output & ~queue_output_valid);
 }
 
 bool input_queue_is_active() {
-  return queue_next;
+  for (InputQueueMacro& macro : queue_macros) {
+    if (queue_macro_state(&macro) == InputQueueMacroState::Active) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void input_queue_set_active(InputQueue* queue, bool consume) {
-  ScopedIRQLock lock;
+  atomic_val_t request = queue_request_stop;
+  if (queue) {
+    InputQueueMacro* macro = queue->macro;
+    bool sealed;
+    {
+      ScopedQueueAllocLock lock;
+      sealed = queue_seal(macro);
+    }
 
-  input_queue_free(queue_next_free_head);
-  queue_next_free_head = nullptr;
+    if (!sealed) {
+      LOG_ERR("failed to allocate space for the end of the queue");
+      if (consume) {
+        input_queue_free(queue);
+      }
+    } else {
+      atomic_set(&macro->consume, consume);
+      queue_macro_set_state(macro, InputQueueMacroState::Active);
+      request = macro - queue_macros + 1;
+    }
+  }
 
-  queue_next = queue;
-  queue_next_tick = k_uptime_ticks();
-  if (consume) {
-    queue_next_free_head = queue;
+  // A request that was replaced before playback picked it up is never played.
+  InputQueueMacro* replaced = queue_request_macro(atomic_set(&queue_request, request));
+  if (replaced && replaced != queue_request_macro(request)) {
+    queue_macro_finish(replaced);
   }
+  queue_start();
 }
 
 #endif
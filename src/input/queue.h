@@ -5,18 +5,28 @@
 #include "input/input.h"
 #include "types.h"
 
+struct InputQueueMacro;
+
+// A node in a queue of inputs.
+//
+// Queues are stored in a compact encoded form, and nodes are only a view of the end of a queue:
+// a node must be filled in before anything is appended to it, and only the head (which owns the
+// rest of the queue) and the most recently appended node remain valid.
 struct InputQueue {
   // State to set inputs to when resolving queue.
   RawInputState state;
 
-  // Delay until the next element of the queue.
-  k_timeout_t delay;
+  // Delay until the next element of the queue, in frames (see input_queue_frame and
+  // input_queue_delay_frames).
+  uint32_t delay;
 
-  // Next entry in the queue, or nullptr.
-  // The head of the queue owns the tail: freeing a node will free everything following it.
-  InputQueue* next;
+  // The queue that this node belongs to.
+  InputQueueMacro* macro;
 };
 
+// Allocate the head of a new queue. At most CONFIG_PASSINGLINK_INPUT_QUEUE_MACRO_COUNT queues can
+// exist at once (a queue exists until it's freed, or until it finishes playing if it's consumed):
+// beyond that, or when storage is exhausted, this returns nullptr.
 InputQueue* input_queue_alloc();
 InputQueue* input_queue_alloc_autofree();
 
@@ -26,8 +36,40 @@ void input_queue_free(InputQueue* p);
 // The new node inherits autofree state from the head.
 InputQueue* input_queue_append(InputQueue* head);
 
+// Queue storage usage, in bytes.
+struct InputQueueStats {
+  size_t capacity;
+  size_t in_use;
+
+  // Maximum amount of storage that has been in use at once.
+  size_t high_water;
+
+  // Number of times allocating or appending has failed because storage was exhausted.
+  size_t alloc_failures;
+};
+
+InputQueueStats input_queue_get_stats();
+
+// The inputs being played back, if any. Safe to call from any context, and never waits for
+// playback, which is advanced separately (see input_queue_frame).
 optional<RawInputState> input_queue_get_state();
 
+// Queues are clocked in 1 ms frames. With CONFIG_PASSINGLINK_INPUT_QUEUE_FRAME_CLOCK, these are
+// the host's USB frames, and calling this at every start of frame counts them and advances
+// playback, so that queued inputs stay locked to the host's polling. Otherwise, or if there hasn't
+// been a start of frame for more than a frame, they're milliseconds of uptime, and playback is
+// advanced by a timer.
+void input_queue_frame();
+
+// The delay in frames for an entry that should last delay_us, in a sequence whose entries so far
+// add up to *elapsed_us (which starts at 0, and is updated). Durations that aren't a whole number
+// of frames are rounded up or down from one entry to the next, so that the error doesn't add up.
+inline uint32_t input_queue_delay_frames(uint64_t* elapsed_us, uint32_t delay_us) {
+  uint64_t begin = *elapsed_us / 1000;
+  *elapsed_us += delay_us;
+  return *elapsed_us / 1000 - begin;
+}
+
 bool input_queue_is_active();
 
 // Set the currently active InputQueue.
@@ -0,0 +1,295 @@
+#include "input/record.h"
+
+#include <zephyr.h>
+
+#include <storage/flash_map.h>
+
+#include <logging/log.h>
+
+#include "input/clock.h"
+
+#define LOG_LEVEL LOG_LEVEL_INF
+LOG_MODULE_REGISTER(record);
+
+#if defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+
+// The recording is a ring buffer of entries: when it fills up, the oldest entries are folded into
+// record_initial_state to make room. Offsets into it are monotonic, and wrapped on access.
+static uint8_t record_buffer[CONFIG_PASSINGLINK_INPUT_RECORD_BUFFER_SIZE];
+static size_t record_head;
+static size_t record_tail;
+
+static uint32_t record_initial_state;
+static uint32_t record_last_state;
+static uint64_t record_last_cycle;
+static bool record_active;
+
+static bool replay_active;
+static size_t replay_offset;
+static uint32_t replay_state;
+static uint64_t replay_next_cycle;
+
+static uint8_t record_read_byte(size_t* offset) {
+  return record_buffer[(*offset)++ % sizeof(record_buffer)];
+}
+
+static uint64_t record_read_varint(size_t* offset) {
+  uint64_t result = 0;
+  for (size_t shift = 0;; shift += 7) {
+    uint8_t byte = record_read_byte(offset);
+    result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return result;
+    }
+  }
+}
+
+// Read the changes of an entry (after its delay), and apply them to state.
+static void record_read_changes(size_t* offset, uint32_t* state) {
+  size_t changed = record_read_byte(offset);
+  for (size_t i = 0; i < changed; ++i) {
+    *state ^= 1U << record_read_byte(offset);
+  }
+}
+
+static void record_evict() {
+  record_read_varint(&record_tail);
+  record_read_changes(&record_tail, &record_initial_state);
+}
+
+void input_record_start() {
+  ScopedIRQLock lock;
+  replay_active = false;
+  record_head = 0;
+  record_tail = 0;
+  record_initial_state = record_last_state;
+  record_last_cycle = input_clock_now();
+  record_active = true;
+}
+
+void input_record_stop() {
+  record_active = false;
+}
+
+bool input_record_is_active() {
+  return record_active;
+}
+
+void input_record_sample(const RawInputState& state) {
+  if (!record_active) {
+    return;
+  }
+
+  ScopedIRQLock lock;
+  uint32_t mask = raw_input_state_to_mask(state);
+  uint32_t changed = mask ^ record_last_state;
+  if (!changed || replay_active) {
+    return;
+  }
+
+  uint8_t entry[10 + 1 + PL_GPIO_COUNT];
+  size_t length = 0;
+
+  uint64_t now = input_clock_now();
+  uint64_t delay = now - record_last_cycle;
+  while (delay >= 0x80) {
+    entry[length++] = (delay & 0x7F) | 0x80;
+    delay >>= 7;
+  }
+  entry[length++] = delay;
+
+  entry[length++] = __builtin_popcount(changed);
+  while (changed) {
+    entry[length++] = __builtin_ctz(changed);
+    changed &= changed - 1;
+  }
+
+  while (sizeof(record_buffer) - (record_head - record_tail) < length) {
+    record_evict();
+  }
+
+  for (size_t i = 0; i < length; ++i) {
+    record_buffer[record_head++ % sizeof(record_buffer)] = entry[i];
+  }
+
+  record_last_cycle = now;
+  record_last_state = mask;
+}
+
+static RecordingHeader record_header() {
+  return {
+    .magic = RecordingHeader::kMagic,
+    .cycles_per_second = sys_clock_hw_cycles_per_sec(),
+    .initial_state = record_initial_state,
+    .length = static_cast<uint32_t>(record_head - record_tail),
+  };
+}
+
+size_t input_record_export_size() {
+  ScopedIRQLock lock;
+  return sizeof(RecordingHeader) + record_head - record_tail;
+}
+
+size_t input_record_export(size_t offset, span<uint8_t> buf) {
+  ScopedIRQLock lock;
+  RecordingHeader header = record_header();
+  size_t total = sizeof(header) + header.length;
+
+  size_t length = 0;
+  while (length < buf.size() && offset < total) {
+    if (offset < sizeof(header)) {
+      buf[length++] = reinterpret_cast<const uint8_t*>(&header)[offset++];
+    } else {
+      size_t ring_offset = record_tail + offset++ - sizeof(header);
+      buf[length++] = record_read_byte(&ring_offset);
+    }
+  }
+  return length;
+}
+
+bool input_record_replay_start() {
+  ScopedIRQLock lock;
+  record_active = false;
+  if (record_head == record_tail) {
+    return false;
+  }
+
+  replay_offset = record_tail;
+  replay_state = record_initial_state;
+  replay_next_cycle = input_clock_now() + record_read_varint(&replay_offset);
+  replay_active = true;
+  return true;
+}
+
+void input_record_replay_stop() {
+  replay_active = false;
+}
+
+bool input_record_replay_is_active() {
+  return replay_active;
+}
+
+optional<RawInputState> input_record_replay_get_state() {
+  if (!replay_active) {
+    return {};
+  }
+
+  ScopedIRQLock lock;
+  uint64_t now = input_clock_now();
+
+  // Unlike the input queue, apply every entry that's due, to keep the original timing.
+  while (replay_next_cycle <= now) {
+    record_read_changes(&replay_offset, &replay_state);
+    if (replay_offset == record_head) {
+      replay_active = false;
+      break;
+    }
+    replay_next_cycle += record_read_varint(&replay_offset);
+  }
+
+  return raw_input_state_from_mask(replay_state);
+}
+
+#if FLASH_AREA_LABEL_EXISTS(recording)
+bool input_record_save() {
+  input_record_stop();
+  input_record_replay_stop();
+
+  const struct flash_area* flash_area;
+  if (flash_area_open(FLASH_AREA_ID(recording), &flash_area) != 0) {
+    LOG_ERR("input_record_save: failed to open flash area");
+    return false;
+  }
+
+  size_t size = input_record_export_size();
+  if (size > flash_area->fa_size) {
+    LOG_ERR("input_record_save: recording too large (%zu bytes)", size);
+    return false;
+  }
+
+  if (flash_area_erase(flash_area, 0, flash_area->fa_size) != 0) {
+    LOG_ERR("input_record_save: failed to erase flash area");
+    return false;
+  }
+
+  // Write in chunks that are a multiple of any flash write block size, padding the last one.
+  uint8_t chunk[64];
+  for (size_t offset = 0; offset < size; offset += sizeof(chunk)) {
+    memset(chunk, 0xFF, sizeof(chunk));
+    input_record_export(offset, chunk);
+    if (flash_area_write(flash_area, offset, chunk, sizeof(chunk)) != 0) {
+      LOG_ERR("input_record_save: failed to write flash area");
+      return false;
+    }
+  }
+
+  LOG_INF("saved %zu byte recording", size);
+  return true;
+}
+
+bool input_record_load() {
+  input_record_stop();
+  input_record_replay_stop();
+
+  const struct flash_area* flash_area;
+  if (flash_area_open(FLASH_AREA_ID(recording), &flash_area) != 0) {
+    LOG_ERR("input_record_load: failed to open flash area");
+    return false;
+  }
+
+  RecordingHeader header;
+  if (flash_area_read(flash_area, 0, &header, sizeof(header)) != 0) {
+    LOG_ERR("input_record_load: failed to read flash area");
+    return false;
+  }
+
+  if (header.magic != RecordingHeader::kMagic) {
+    LOG_ERR("input_record_load: no recording saved");
+    return false;
+  } else if (header.cycles_per_second != sys_clock_hw_cycles_per_sec()) {
+    LOG_ERR("input_record_load: recording was made at %u cycles per second",
+            header.cycles_per_second);
+    return false;
+  } else if (header.length > sizeof(record_buffer)) {
+    LOG_ERR("input_record_load: recording too large (%u bytes)", header.length);
+    return false;
+  }
+
+  // Flash is slow to read, so read it in chunks into a staging buffer with interrupts unlocked, and
+  // only copy each chunk in under the lock. The recording reads as empty until it's all loaded.
+  {
+    ScopedIRQLock lock;
+    record_head = record_tail = 0;
+  }
+
+  uint8_t chunk[64];
+  for (size_t offset = 0; offset < header.length; offset += sizeof(chunk)) {
+    size_t length = min(sizeof(chunk), header.length - offset);
+    if (flash_area_read(flash_area, sizeof(header) + offset, chunk, length) != 0) {
+      LOG_ERR("input_record_load: failed to read flash area");
+      return false;
+    }
+
+    ScopedIRQLock lock;
+    memcpy(record_buffer + offset, chunk, length);
+  }
+
+  ScopedIRQLock lock;
+  record_tail = 0;
+  record_head = header.length;
+  record_initial_state = header.initial_state;
+  return true;
+}
+#else
+bool input_record_save() {
+  LOG_ERR("no recording partition defined");
+  return false;
+}
+
+bool input_record_load() {
+  LOG_ERR("no recording partition defined");
+  return false;
+}
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+#if defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+
+#include "input/input.h"
+#include "types.h"
+
+// Recording of raw inputs, for reproducing timing-sensitive bugs and benchmarking against real
+// input traces.
+//
+// Recordings are exported as a RecordingHeader followed by a stream of entries, each of which is:
+//   varint input clock ticks since the previous entry (little-endian base-128)
+//   uint8_t number of inputs that changed
+//   uint8_t RawInputState offsets of the inputs that changed
+struct __attribute__((packed)) RecordingHeader {
+  static constexpr uint32_t kMagic = 0x1209214d;
+
+  uint32_t magic;
+
+  // Frequency of the input clock (see input/clock.h).
+  uint32_t cycles_per_second;
+
+  // RawInputState mask at the start of the recording.
+  uint32_t initial_state;
+
+  // Length of the entries following the header, in bytes.
+  uint32_t length;
+};
+
+void input_record_start();
+void input_record_stop();
+bool input_record_is_active();
+
+// Record a sample of raw input. Only changes are stored.
+void input_record_sample(const RawInputState& state);
+
+// Total size of the exported recording, and a chunk of it.
+size_t input_record_export_size();
+size_t input_record_export(size_t offset, span<uint8_t> buf);
+
+// Replay the recording through the input queue, with the original timing.
+bool input_record_replay_start();
+void input_record_replay_stop();
+bool input_record_replay_is_active();
+
+// Called by input_queue_get_state.
+optional<RawInputState> input_record_replay_get_state();
+
+// Save the recording to (or load it from) the recording flash partition, if one exists.
+bool input_record_save();
+bool input_record_load();
+
+#endif
@@ -129,3 +129,124 @@ StickOutput::Axis input_socd_parse(SOCDType type, span<SOCDInputs> inputs) {
     .tick = newest_tick.get_or(0),
   };
 }
+
+// input_socd_resolve reduces the pressed inputs to the state of three groups (positive, neutral
+// and negative, in that order), and looks the result up in a table shared by every profile (the
+// SOCD type can change independently of the profile), indexed by:
+//   bits 0-2: which groups are pressed
+//   bits 3-4: the group with the newest press, preferring earlier groups on ties
+//   bit 5:    whether the newest negative press is newer than the newest positive one
+static constexpr size_t SOCD_GROUP_POSITIVE = 0;
+static constexpr size_t SOCD_GROUP_NEUTRAL = 1;
+static constexpr size_t SOCD_GROUP_NEGATIVE = 2;
+static constexpr size_t SOCD_GROUP_NONE = 3;
+
+struct SOCDLookupEntry {
+  int8_t value;
+
+  // The group whose tick is the result's tick, or SOCD_GROUP_NONE for 0.
+  uint8_t tick_group;
+};
+
+struct SOCDLookup {
+  constexpr SOCDLookup() {
+    for (size_t type = 0; type < 4; ++type) {
+      for (size_t index = 0; index < 64; ++index) {
+        entries[type][index] = resolve(static_cast<SOCDType>(type), index);
+      }
+    }
+  }
+
+  static constexpr SOCDLookupEntry resolve(SOCDType type, size_t index) {
+    bool positive = index & BIT(SOCD_GROUP_POSITIVE);
+    bool negative = index & BIT(SOCD_GROUP_NEGATIVE);
+    bool any = index & BIT_MASK(3);
+    size_t newest = (index >> 3) & BIT_MASK(2);
+    bool negative_newer = index & BIT(5);
+
+    switch (type) {
+      case SOCDType::Neutral:
+        if (positive && negative) {
+          return { 0, static_cast<uint8_t>(negative_newer ? SOCD_GROUP_NEGATIVE
+                                                          : SOCD_GROUP_POSITIVE) };
+        } else if (positive) {
+          return { 1, SOCD_GROUP_POSITIVE };
+        } else if (negative) {
+          return { -1, SOCD_GROUP_NEGATIVE };
+        }
+        return { 0, SOCD_GROUP_NONE };
+
+      case SOCDType::Positive:
+        if (positive) {
+          return { 1, SOCD_GROUP_POSITIVE };
+        } else if (negative) {
+          return { -1, SOCD_GROUP_NEGATIVE };
+        }
+        return { 0, SOCD_GROUP_NONE };
+
+      case SOCDType::Negative:
+        if (negative) {
+          return { -1, SOCD_GROUP_NEGATIVE };
+        } else if (positive) {
+          return { 1, SOCD_GROUP_POSITIVE };
+        }
+        return { 0, SOCD_GROUP_NONE };
+
+      case SOCDType::Last:
+        if (any && newest < SOCD_GROUP_NONE) {
+          return { static_cast<int8_t>(1 - static_cast<int>(newest)),
+                   static_cast<uint8_t>(newest) };
+        }
+        return { 0, SOCD_GROUP_NONE };
+    }
+
+    return { 0, SOCD_GROUP_NONE };
+  }
+
+  SOCDLookupEntry entries[4][64] = {};
+};
+
+static constexpr SOCDLookup socd_lookup;
+
+StickOutput::Axis input_socd_resolve(SOCDType type, const SOCDAxisIndex& index, uint32_t raw,
+                                     const ButtonHistory& history) {
+  if (raw & index.override_mask) {
+    for (size_t i = 0; i < index.override_count; ++i) {
+      const SOCDAxisIndex::Override& input = index.overrides[i];
+      if ((raw >> input.input) & 1) {
+        return StickOutput::Axis {
+          .value = input.value,
+          .tick = history.values[input.input].tick,
+        };
+      }
+    }
+  }
+
+  // Newest tick of each group. Groups that aren't pressed (and SOCD_GROUP_NONE) stay at 0.
+  uint64_t ticks[4] = {};
+  uint32_t pressed = 0;
+
+  for (size_t group = 0; group < SOCD_GROUP_NONE; ++group) {
+    uint32_t members = raw & index.group_masks[group];
+    pressed |= (members != 0) << group;
+    while (members) {
+      ticks[group] = max(ticks[group], history.values[__builtin_ctz(members)].tick);
+      members &= members - 1;
+    }
+  }
+
+  size_t newest = pressed ? __builtin_ctz(pressed) : SOCD_GROUP_NONE;
+  for (size_t group = newest + 1; group < SOCD_GROUP_NONE; ++group) {
+    if ((pressed & BIT(group)) && ticks[group] > ticks[newest]) {
+      newest = group;
+    }
+  }
+
+  size_t key = pressed | (newest << 3) |
+               (ticks[SOCD_GROUP_NEGATIVE] > ticks[SOCD_GROUP_POSITIVE]) << 5;
+  const SOCDLookupEntry& entry = socd_lookup.entries[static_cast<size_t>(type)][key];
+  return StickOutput::Axis {
+    .value = entry.value,
+    .tick = ticks[entry.tick_group],
+  };
+}
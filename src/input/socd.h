@@ -1,6 +1,7 @@
 #pragma once
 
 #include "input/input.h"
+#include "input/profile_types.h"
 
 enum class SOCDType : size_t {
   // Neutral.
@@ -53,4 +54,38 @@ struct SOCDInputs {
   bool overrides = false;
 };
 
+// Reference implementation of SOCD resolution.
 StickOutput::Axis input_socd_parse(SOCDType type, span<SOCDInputs> inputs);
+
+// The SOCD inputs of one stick axis of a profile, indexed by RawInputState offset when the profile
+// is compiled, so that resolving them only does work for the inputs that are actually pressed.
+struct SOCDAxisIndex {
+  constexpr void add(uint8_t input, SOCDButtonType type, bool overrides) {
+    if (overrides) {
+      override_mask |= 1U << input;
+      this->overrides[override_count++] = { input, static_cast<int8_t>(type) };
+    } else {
+      group_masks[1 - static_cast<int>(type)] |= 1U << input;
+    }
+  }
+
+  // Inputs without overrides, by group: positive, neutral, negative.
+  uint32_t group_masks[3] = {};
+
+  // Inputs with overrides, in the order they were added: the first one that's pressed wins.
+  struct Override {
+    uint8_t input;
+    int8_t value;
+  };
+
+  uint32_t override_mask = 0;
+  size_t override_count = 0;
+  Override overrides[PROFILE_MAX_SOCD_INPUTS] = {};
+};
+
+// Equivalent to input_socd_parse on the inputs of an index, with their values taken from raw and
+// their ticks from history. The pressed inputs of each group are reduced to the group's newest
+// tick, and the result is a single lookup in a table indexed by which groups are pressed and
+// their recency.
+StickOutput::Axis input_socd_resolve(SOCDType type, const SOCDAxisIndex& index, uint32_t raw,
+                                     const ButtonHistory& history);
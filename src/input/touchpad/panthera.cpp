@@ -12,6 +12,7 @@
 LOG_MODULE_REGISTER(touchpad);
 
 #include "arch.h"
+#include "metrics/trace.h"
 #include "profiling.h"
 #include "types.h"
 
@@ -71,14 +72,16 @@ void input_touchpad_poll() {
     return;
   };
 
-  PROFILE("input_touchpad_poll", 128);
+  PROFILE("input_touchpad_poll");
   TouchpadData* output = &touchpad_data;
   TouchpadOutput input;
 
   uint8_t reg = TP_OUTPUT_REGISTER;
   input.touchpoints = 0;
 
+  TRACE(TouchpadI2CBegin, 0);
   int rc = i2c_write_read(tp_i2c_device, TP_I2C_ADDRESS, &reg, sizeof(reg), &input, sizeof(input));
+  TRACE(TouchpadI2CEnd, rc);
 
   if (rc != 0) {
     if (!succeeded_once) {
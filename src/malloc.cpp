@@ -1,3 +1,5 @@
+#include "malloc.h"
+
 #if defined(CONFIG_PASSINGLINK_ALLOCATOR)
 #include <zephyr.h>
 
@@ -13,8 +15,6 @@ LOG_MODULE_REGISTER(malloc);
 
 #define ALLOC_HWM 0
 
-extern "C" void dump_allocator_hwm();
-
 template <size_t Bits>
 struct Bitset {
   static constexpr size_t Bytes = (Bits + 7) / 8;
@@ -111,9 +111,13 @@ struct Allocator {
 
   void* malloc(size_t size) {
     // clang-format off
-#define BUCKET(block_size, count)               \
-    if (size <= block_size) {                   \
-      return (bucket_##block_size).alloc(size); \
+#define BUCKET(block_size, count)                       \
+    if (size <= block_size) {                           \
+      void* result = (bucket_##block_size).alloc(size); \
+      if (result) {                                     \
+        update_high_water(block_size);                  \
+      }                                                 \
+      return result;                                    \
     }
     BUCKETS()
 #undef BUCKET
@@ -130,6 +134,7 @@ struct Allocator {
       auto* bucket = &bucket_##block_size;     \
       auto* bucket_end = bucket + 1;           \
       if (ptr >= bucket && ptr < bucket_end) { \
+        in_use_ -= block_size;                 \
         return bucket->free(ptr);              \
       }                                        \
     }
@@ -145,6 +150,15 @@ struct Allocator {
     BUCKETS()
 #undef BUCKETS
   }
+
+  void update_high_water(size_t block_size) {
+    in_use_ += block_size;
+    high_water_ = max(high_water_, in_use_);
+  }
+
+  // Bytes of blocks handed out, now and at most.
+  size_t in_use_ = 0;
+  size_t high_water_ = 0;
 };
 
 static Allocator allocator;
@@ -161,8 +175,16 @@ extern "C" void dump_allocator_hwm() {
   allocator.dump_hwm();
 }
 
+extern "C" size_t allocator_get_high_water() {
+  return allocator.high_water_;
+}
+
 #else
 
 extern "C" void dump_allocator_hwm() {}
 
+extern "C" size_t allocator_get_high_water() {
+  return 0;
+}
+
 #endif  // defined(CONFIG_PASSINGLINK_ALLOCATOR)
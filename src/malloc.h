@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+
+// Implemented in malloc.cpp, as no-ops when CONFIG_PASSINGLINK_ALLOCATOR is disabled.
+extern "C" void dump_allocator_hwm();
+
+// Most bytes that have been allocated at once.
+extern "C" size_t allocator_get_high_water();
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "types.h"
+
+struct HistogramSummary {
+  uint32_t count;
+  uint32_t min;
+  uint32_t p50;
+  uint32_t p90;
+  uint32_t p99;
+  uint32_t p999;
+  uint32_t max;
+};
+
+// Fixed-size log-linear histogram, in the style of HdrHistogram.
+//
+// Values below 2^SubBucketBits get a bucket each. Above that, every power of two is split into
+// 2^SubBucketBits equally sized buckets, so that a bucket pins down the values in it to within
+// 1 / 2^SubBucketBits of each other. Values of 2^MaxBits or more share an overflow bucket.
+//
+// Recording is an increment of the value's bucket (plus tracking the exact min and max), so it's
+// cheap enough for an ISR. It isn't synchronized: readers that can preempt, or be preempted by,
+// the recorder need to lock interrupts.
+template <size_t SubBucketBits, size_t MaxBits>
+struct Histogram {
+  static_assert(SubBucketBits < MaxBits && MaxBits < 32);
+
+  static constexpr size_t kSubBuckets = 1U << SubBucketBits;
+  static constexpr size_t kOverflowBucket = (MaxBits - SubBucketBits + 1) * kSubBuckets;
+  static constexpr size_t kBucketCount = kOverflowBucket + 1;
+
+  static size_t bucket(uint32_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+
+    size_t exponent = 31 - __builtin_clz(value);
+    if (exponent >= MaxBits) {
+      return kOverflowBucket;
+    }
+
+    size_t shift = exponent - SubBucketBits;
+    return (shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+  }
+
+  // The smallest value that lands in a bucket.
+  static uint32_t bucket_lower_bound(size_t idx) {
+    if (idx < kSubBuckets) {
+      return idx;
+    } else if (idx == kOverflowBucket) {
+      return 1U << MaxBits;
+    }
+
+    size_t shift = idx / kSubBuckets - 1;
+    return (kSubBuckets + idx % kSubBuckets) << shift;
+  }
+
+  // The largest value that lands in a bucket.
+  static uint32_t bucket_upper_bound(size_t idx) {
+    if (idx == kOverflowBucket) {
+      return UINT32_MAX;
+    }
+    return bucket_lower_bound(idx + 1) - 1;
+  }
+
+  void record(uint32_t value) {
+    ++counts_[bucket(value)];
+    min_ = min(min_, value);
+    max_ = max(max_, value);
+  }
+
+  void reset() {
+    memset(counts_, 0, sizeof(counts_));
+    min_ = UINT32_MAX;
+    max_ = 0;
+  }
+
+  uint32_t count() const {
+    uint32_t result = 0;
+    for (uint32_t count : counts_) {
+      result += count;
+    }
+    return result;
+  }
+
+  // The highest value equivalent to the value at a percentile, i.e. the upper bound of its bucket,
+  // clamped to the recorded range.
+  uint32_t percentile(uint32_t total, uint32_t per_mille) const {
+    if (total == 0) {
+      return 0;
+    }
+
+    uint64_t target = (static_cast<uint64_t>(total) * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      seen += counts_[i];
+      if (seen >= target) {
+        return max(min_, min(max_, bucket_upper_bound(i)));
+      }
+    }
+    return max_;
+  }
+
+  HistogramSummary summarize() const {
+    uint32_t total = count();
+    return {
+      .count = total,
+      .min = total ? min_ : 0,
+      .p50 = percentile(total, 500),
+      .p90 = percentile(total, 900),
+      .p99 = percentile(total, 990),
+      .p999 = percentile(total, 999),
+      .max = max_,
+    };
+  }
+
+  uint32_t counts_[kBucketCount] = {};
+  uint32_t min_ = UINT32_MAX;
+  uint32_t max_ = 0;
+};
@@ -1,5 +1,17 @@
 #pragma once
 
+#include "metrics/histogram.h"
+
+// 12.5% resolution, up to ~65 ms.
+using LatencyHistogram = Histogram<3, 16>;
+
 void metrics_reset();
 void metrics_record_input_read();
 void metrics_record_usb_write();
+
+// Summary of the latency from reading input to writing the report, in microseconds, since the last
+// reset.
+HistogramSummary metrics_get_latency();
+
+// Snapshot of the full latency histogram.
+void metrics_get_latency_histogram(LatencyHistogram* out);
@@ -0,0 +1,33 @@
+#include "metrics/trace.h"
+
+#include <zephyr.h>
+
+#include "types.h"
+
+#if defined(CONFIG_PASSINGLINK_TRACE)
+
+TraceEntry trace_buffer[TRACE_BUFFER_SIZE];
+atomic_t trace_head;
+bool trace_enabled;
+
+void trace_start() {
+  trace_enabled = false;
+  atomic_set(&trace_head, 0);
+  memset(trace_buffer, 0, sizeof(trace_buffer));
+  trace_enabled = true;
+}
+
+void trace_stop() {
+  trace_enabled = false;
+}
+
+size_t trace_count() {
+  return min<size_t>(atomic_get(&trace_head), TRACE_BUFFER_SIZE);
+}
+
+TraceEntry trace_get(size_t idx) {
+  uint32_t head = atomic_get(&trace_head);
+  return trace_buffer[(head - trace_count() + idx) % TRACE_BUFFER_SIZE];
+}
+
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <zephyr.h>
+
+#include <sys/atomic.h>
+
+#include "input/clock.h"
+
+// Trace points along the input pipeline, recorded into a ring buffer with the input clock
+// (input_clock_sample, which unlike get_cycle_count keeps counting while the core sleeps), the
+// context they ran in, and an argument. Dump the buffer with the `trace`
+// shell command, and convert it into Chrome trace JSON with scripts/trace_to_json.py.
+//
+// Stages that end in Begin or End bracket a span of time, the others are instantaneous.
+// scripts/trace_to_json.py has a copy of this list, and needs to be kept in sync.
+#define PL_TRACE_STAGES()           \
+  PL_TRACE_STAGE(GpioSample)        \
+  PL_TRACE_STAGE(DebounceResult)    \
+  PL_TRACE_STAGE(SOCDResolve)       \
+  PL_TRACE_STAGE(ReportEncodeBegin) \
+  PL_TRACE_STAGE(ReportEncodeEnd)   \
+  PL_TRACE_STAGE(UsbWriteBegin)     \
+  PL_TRACE_STAGE(UsbWriteEnd)       \
+  PL_TRACE_STAGE(IntInReady)        \
+  PL_TRACE_STAGE(TouchpadI2CBegin)  \
+  PL_TRACE_STAGE(TouchpadI2CEnd)    \
+  PL_TRACE_STAGE(DisplayBlitBegin)  \
+  PL_TRACE_STAGE(DisplayBlitEnd)
+
+enum class TraceStage : uint8_t {
+#define PL_TRACE_STAGE(name) name,
+  PL_TRACE_STAGES()
+#undef PL_TRACE_STAGE
+};
+
+#if defined(CONFIG_PASSINGLINK_TRACE)
+
+struct TraceEntry {
+  uint32_t cycle;
+
+  // The current thread, or the exception number if in an interrupt (which can't be confused with
+  // a thread pointer, since those are aligned and far from 0).
+  uint32_t context;
+
+  uint32_t arg;
+  TraceStage stage;
+};
+
+static constexpr size_t TRACE_BUFFER_SIZE = CONFIG_PASSINGLINK_TRACE_BUFFER_SIZE;
+static_assert((TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) == 0, "must be a power of two");
+
+extern TraceEntry trace_buffer[TRACE_BUFFER_SIZE];
+extern atomic_t trace_head;
+extern bool trace_enabled;
+
+static ALWAYS_INLINE uint32_t trace_context() {
+#if defined(__arm__)
+  uint32_t ipsr;
+  __asm__ volatile("mrs %0, ipsr" : "=r"(ipsr));
+  if (ipsr) {
+    return ipsr;
+  }
+#endif
+  return reinterpret_cast<uintptr_t>(k_current_get());
+}
+
+// Safe to call from any context: each call claims a slot with a single atomic increment. The clock
+// is sampled after claiming the slot, which keeps entries in order unless an interrupt lands
+// between the two, in which case the interrupt's entry comes later in the buffer but with an
+// earlier cycle: readers need to order entries by cycle, not by position.
+static ALWAYS_INLINE void trace_record(TraceStage stage, uint32_t arg) {
+  if (!trace_enabled) {
+    return;
+  }
+
+  TraceEntry& entry = trace_buffer[atomic_inc(&trace_head) % TRACE_BUFFER_SIZE];
+  entry.cycle = input_clock_sample();
+  entry.context = trace_context();
+  entry.arg = arg;
+  entry.stage = stage;
+}
+
+void trace_start();
+void trace_stop();
+
+// Read the buffer, oldest entry first. Tracing should be stopped first.
+size_t trace_count();
+TraceEntry trace_get(size_t idx);
+
+#define TRACE(stage, arg) trace_record(TraceStage::stage, (arg))
+
+#else
+
+#define TRACE(stage, arg) \
+  do {                    \
+  } while (0)
+
+#endif
@@ -56,6 +56,7 @@ void adjust_cam(int8_t offset, bool record) {
       return;
     }
 
+    uint64_t elapsed_us = 0;
     InputQueue* cur = head;
     for (size_t i = 0; i < count; ++i) {
       cur->state = {};
@@ -64,7 +65,7 @@ void adjust_cam(int8_t offset, bool record) {
       } else {
         cur->state.stick_down = 1;
       }
-      cur->delay = K_USEC(33'333);
+      cur->delay = input_queue_delay_frames(&elapsed_us, 33'333);
       cur = input_queue_append(cur);
       if (!cur) {
         LOG_ERR("failed to allocate!");
@@ -73,7 +74,7 @@ void adjust_cam(int8_t offset, bool record) {
       }
 
       cur->state = {};
-      cur->delay = K_USEC(33'333);
+      cur->delay = input_queue_delay_frames(&elapsed_us, 33'333);
       cur = input_queue_append(cur);
       if (!cur) {
         LOG_ERR("failed to allocate!");
@@ -83,7 +84,7 @@ void adjust_cam(int8_t offset, bool record) {
     }
 
     cur->state = {};
-    cur->delay = K_USEC(0);
+    cur->delay = 0;
     input_queue_set_active(head, true);
   }
 }
@@ -6,9 +6,18 @@
 #include <usb/class/usb_hid.h>
 #include <usb/usb_device.h>
 
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER)
+#include <drivers/counter.h>
+#endif
+
 #include "bootloader.h"
+#include "input/clock.h"
+#include "input/profile.h"
+#include "input/queue.h"
+#include "input/record.h"
 #include "input/touchpad.h"
 #include "metrics/metrics.h"
+#include "metrics/trace.h"
 #include "output/output.h"
 #include "output/usb/hid.h"
 #include "output/usb/nx/hid.h"
@@ -21,6 +30,7 @@
 LOG_MODULE_REGISTER(hid);
 
 #include "arch.h"
+#include "malloc.h"
 #include "profiling.h"
 
 static Hid* hid;
@@ -32,6 +42,13 @@ static optional<int64_t> suspend_timestamp;
 static struct k_delayed_work delayed_write_work;
 #endif
 
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER)
+// Hardware counter used to schedule deferred writes, or null if we've fallen back to
+// delayed work.
+static const struct device* write_counter;
+static struct k_work counter_write_work;
+#endif
+
 // USB transfers works on a host-polled basis: we put data into registers for
 // the hardware to send to the host. When this data gets succesfully sent, we
 // get notified to fill the bin with more data. As a result, if we immediately
@@ -41,18 +58,348 @@ static struct k_delayed_work delayed_write_work;
 // interval, which reduces average latency by that amount, as long as it's short
 // enough that we actually manage to finish the write before the interval elapses.
 //
-// TODO: Instead of using work queue timing (with ~100us precision), use a timer
-//       interrupt which is far more precise?
+// Work queue timing only has tick precision (~100us), so if a hardware counter is available
+// (CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER), its alarm interrupt is used instead.
 #if defined(STM32)
-constexpr uint32_t DEFAULT_HID_REPORT_DELAY_TICKS = k_us_to_ticks_ceil32(700);
+constexpr uint32_t DEFAULT_HID_REPORT_DELAY_US = 700;
 #elif defined(NRF52840)
-constexpr uint32_t DEFAULT_HID_REPORT_DELAY_TICKS = 22;
-static_assert(k_ticks_to_us_ceil32(DEFAULT_HID_REPORT_DELAY_TICKS) == 672);
+// 22 ticks of the 32.768 kHz RTC: K_USEC rounds up, so this has to be just under 22 ticks' worth
+// of microseconds for the delayed work fallback to keep that delay.
+constexpr uint32_t DEFAULT_HID_REPORT_DELAY_US = 671;
+static_assert(k_us_to_ticks_ceil32(DEFAULT_HID_REPORT_DELAY_US) == 22);
 #else
 #error HID_REPORT_DELAY_US unset
 #endif
 
-static uint32_t hid_report_delay_ticks = DEFAULT_HID_REPORT_DELAY_TICKS;
+static uint32_t hid_report_delay_us = DEFAULT_HID_REPORT_DELAY_US;
+
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+// Automatic tuning of hid_report_delay_us.
+//
+// int_in_ready fires right after the host has read a report, so the host's next poll is roughly
+// one polling interval after it. Measure how long after int_in_ready each deferred write
+// completes, and keep the delay as large as possible while still completing every write at
+// least a safety margin before the next poll, across a window of reports (to account for jitter).
+//
+// report_delay_tune_ready runs in int_in_ready (an ISR on STM32), and the rest from the write
+// path, so all of the state below, as well as hid_report_delay_us, is updated with interrupts
+// locked. Intervals span the core sleeping between polls, so they're measured with the input
+// clock rather than get_cycle_count (which stops while the core sleeps on nRF52).
+static bool report_delay_auto = true;
+
+// Number of reports to collect before adjusting the delay.
+static constexpr uint32_t REPORT_DELAY_TUNE_WINDOW = 256;
+
+// Number of windows to wait after backing off before increasing the delay again.
+static constexpr uint32_t REPORT_DELAY_TUNE_HOLD = 16;
+
+// Number of steps to back off by when a poll is missed or a write fails.
+static constexpr uint32_t REPORT_DELAY_TUNE_BACKOFF = 2 * USB_HID_REPORT_DELAY_STEP_US;
+
+static optional<uint32_t> report_delay_tune_ready_cycle;
+static optional<uint32_t> report_delay_tune_write_cycle;
+static uint32_t report_delay_tune_min_slack = UINT32_MAX;
+static uint32_t report_delay_tune_samples;
+static uint32_t report_delay_tune_hold;
+
+static uint32_t report_delay_tune_poll_cycles() {
+  return k_ms_to_cyc_floor32(CONFIG_USB_HID_POLL_INTERVAL_MS);
+}
+
+static uint32_t report_delay_tune_margin_cycles() {
+  return k_us_to_cyc_ceil32(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY_MARGIN_US);
+}
+
+static void report_delay_tune_reset_window() {
+  report_delay_tune_min_slack = UINT32_MAX;
+  report_delay_tune_samples = 0;
+}
+
+static void report_delay_tune_backoff() {
+  ScopedIRQLock lock;
+  if (!report_delay_auto) {
+    return;
+  }
+
+  hid_report_delay_us -= min(hid_report_delay_us, REPORT_DELAY_TUNE_BACKOFF);
+  report_delay_tune_hold = REPORT_DELAY_TUNE_HOLD;
+  report_delay_tune_reset_window();
+}
+
+static void report_delay_tune_adjust() {
+  constexpr uint32_t step = USB_HID_REPORT_DELAY_STEP_US;
+  uint32_t step_cycles = k_us_to_cyc_ceil32(step);
+  uint32_t margin_cycles = report_delay_tune_margin_cycles();
+  uint32_t max_us =
+    1000 * CONFIG_USB_HID_POLL_INTERVAL_MS - CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY_MARGIN_US;
+
+  if (report_delay_tune_min_slack < margin_cycles) {
+    hid_report_delay_us -= min(hid_report_delay_us, step);
+  } else if (report_delay_tune_hold > 0) {
+    --report_delay_tune_hold;
+  } else if (report_delay_tune_min_slack > margin_cycles + step_cycles &&
+             hid_report_delay_us + step <= max_us) {
+    hid_report_delay_us += step;
+  }
+
+  report_delay_tune_reset_window();
+}
+
+// Called from int_in_ready.
+static void report_delay_tune_ready() {
+  ScopedIRQLock lock;
+  uint32_t now = input_clock_sample();
+  if (report_delay_auto && report_delay_tune_ready_cycle && report_delay_tune_write_cycle) {
+    uint32_t poll_cycles = report_delay_tune_poll_cycles();
+    uint32_t interval = now - *report_delay_tune_ready_cycle;
+    uint32_t elapsed = *report_delay_tune_write_cycle - *report_delay_tune_ready_cycle;
+
+    if (interval > poll_cycles * 3 / 2) {
+      // We missed a poll. Only back off if it was our fault: the host might also just not have
+      // polled us (e.g. while suspended).
+      if (elapsed + report_delay_tune_margin_cycles() > poll_cycles) {
+        report_delay_tune_backoff();
+      }
+    } else {
+      uint32_t slack = interval > elapsed ? interval - elapsed : 0;
+      report_delay_tune_min_slack = min(report_delay_tune_min_slack, slack);
+      if (++report_delay_tune_samples == REPORT_DELAY_TUNE_WINDOW) {
+        report_delay_tune_adjust();
+      }
+    }
+  }
+
+  report_delay_tune_ready_cycle = now;
+  report_delay_tune_write_cycle.reset();
+}
+
+// Called after a report has been successfully handed to the hardware.
+static void report_delay_tune_written() {
+  ScopedIRQLock lock;
+  report_delay_tune_write_cycle = input_clock_sample();
+}
+#else
+static void report_delay_tune_ready() {}
+static void report_delay_tune_written() {}
+static void report_delay_tune_backoff() {}
+#endif
+
+// Counters for PLReportId::Telemetry.
+static uint32_t telemetry_reports;
+static uint32_t telemetry_write_failures;
+static uint32_t telemetry_missed_polls;
+static uint32_t telemetry_get_report_calls;
+static uint64_t telemetry_get_report_cycles;
+static uint32_t telemetry_get_report_max_cycles;
+static optional<uint32_t> telemetry_ready_cycle;
+
+// Poll monitor (UsbPollStats): intervals between int_in_ready calls, and runs of failed writes.
+// These can also be reset on their own, by usb_hid_reset_poll_stats (telemetry_reset resets both),
+// so they keep their own counts of missed polls and failed writes.
+static Histogram<3, 16> telemetry_poll_jitter;
+static uint32_t telemetry_poll_intervals;
+static uint32_t telemetry_poll_interval_min_us = UINT32_MAX;
+static uint32_t telemetry_poll_interval_max_us;
+static uint32_t telemetry_poll_missed_polls;
+static uint32_t telemetry_poll_write_failures;
+static uint32_t telemetry_requeues;
+static uint32_t telemetry_failure_streak;
+static uint32_t telemetry_max_failure_streak;
+
+// Ring buffer of the most recent UsbPollEvents. telemetry_poll_event_count is monotonic, and
+// wrapped on access.
+static UsbPollEvent telemetry_poll_events[16];
+static size_t telemetry_poll_event_count;
+
+// Gaps longer than this many polls are treated as the host not polling (e.g. while suspended),
+// not as missed polls.
+static constexpr uint32_t TELEMETRY_RESYNC_POLLS = 16;
+
+static constexpr uint32_t TELEMETRY_POLL_INTERVAL_US = CONFIG_USB_HID_POLL_INTERVAL_MS * 1000;
+
+static void telemetry_poll_reset() {
+  ScopedIRQLock lock;
+  telemetry_poll_jitter.reset();
+  telemetry_poll_intervals = 0;
+  telemetry_poll_interval_min_us = UINT32_MAX;
+  telemetry_poll_interval_max_us = 0;
+  telemetry_poll_missed_polls = 0;
+  telemetry_poll_write_failures = 0;
+  telemetry_requeues = 0;
+  telemetry_max_failure_streak = 0;
+}
+
+static void telemetry_reset() {
+  ScopedIRQLock lock;
+  telemetry_reports = 0;
+  telemetry_write_failures = 0;
+  telemetry_missed_polls = 0;
+  telemetry_get_report_calls = 0;
+  telemetry_get_report_cycles = 0;
+  telemetry_get_report_max_cycles = 0;
+  telemetry_ready_cycle.reset();
+  telemetry_failure_streak = 0;
+  telemetry_poll_reset();
+}
+
+static void telemetry_record_event(UsbPollEventType type, uint32_t count) {
+  ScopedIRQLock lock;
+  telemetry_poll_events[telemetry_poll_event_count++ % ARRAY_SIZE(telemetry_poll_events)] = {
+    .uptime_ms = k_uptime_get_32(),
+    .backend = hid ? hid->Name() : "<none>",
+    .report_delay_us = hid_report_delay_us,
+    .type = type,
+    .count = count,
+  };
+}
+
+// Called from int_in_ready. Polls are timed with the input clock, since the core may sleep between
+// them.
+static void telemetry_ready() {
+  ScopedIRQLock lock;
+  uint32_t now = input_clock_sample();
+  if (telemetry_ready_cycle) {
+    uint32_t poll_cycles = k_ms_to_cyc_floor32(CONFIG_USB_HID_POLL_INTERVAL_MS);
+    uint32_t interval = now - *telemetry_ready_cycle;
+    uint32_t polls = (interval + poll_cycles / 2) / poll_cycles;
+    if (polls < TELEMETRY_RESYNC_POLLS) {
+      uint32_t interval_us = k_cyc_to_us_floor32(interval);
+      uint32_t jitter_us = interval_us > TELEMETRY_POLL_INTERVAL_US
+                             ? interval_us - TELEMETRY_POLL_INTERVAL_US
+                             : TELEMETRY_POLL_INTERVAL_US - interval_us;
+      telemetry_poll_jitter.record(jitter_us);
+      ++telemetry_poll_intervals;
+      telemetry_poll_interval_min_us = min(telemetry_poll_interval_min_us, interval_us);
+      telemetry_poll_interval_max_us = max(telemetry_poll_interval_max_us, interval_us);
+
+      if (interval > poll_cycles * 3 / 2) {
+        telemetry_missed_polls += polls - 1;
+        telemetry_poll_missed_polls += polls - 1;
+        telemetry_record_event(UsbPollEventType::MissedPoll, polls - 1);
+      }
+    }
+  }
+  telemetry_ready_cycle = now;
+}
+
+// Called from write_report with the result of hid_int_ep_write.
+static void telemetry_written(bool success) {
+  ScopedIRQLock lock;
+  if (!success) {
+    ++telemetry_write_failures;
+    ++telemetry_poll_write_failures;
+    if (telemetry_failure_streak++ > 0) {
+      ++telemetry_requeues;
+    }
+    telemetry_max_failure_streak = max(telemetry_max_failure_streak, telemetry_failure_streak);
+    return;
+  }
+
+  ++telemetry_reports;
+  if (telemetry_failure_streak > 1) {
+    telemetry_record_event(UsbPollEventType::Requeue, telemetry_failure_streak);
+  }
+  telemetry_failure_streak = 0;
+}
+
+static void telemetry_record_get_report(uint32_t cycles) {
+  ScopedIRQLock lock;
+  ++telemetry_get_report_calls;
+  telemetry_get_report_cycles += cycles;
+  telemetry_get_report_max_cycles = max(telemetry_get_report_max_cycles, cycles);
+}
+
+static uint32_t telemetry_cycles_to_ns(uint64_t cycles) {
+  return cycles * 1'000'000'000 / get_cpu_freq();
+}
+
+static PLTelemetry telemetry_get() {
+  PLTelemetry result = {};
+  result.version = PLTelemetry::kVersion;
+
+  {
+    ScopedIRQLock lock;
+    result.reports = telemetry_reports;
+    result.write_failures = telemetry_write_failures;
+    result.missed_polls = telemetry_missed_polls;
+    if (telemetry_get_report_calls) {
+      result.get_report_avg_ns =
+        telemetry_cycles_to_ns(telemetry_get_report_cycles / telemetry_get_report_calls);
+    }
+    result.get_report_max_ns = telemetry_cycles_to_ns(telemetry_get_report_max_cycles);
+  }
+
+  result.report_delay_us = hid_report_delay_us;
+
+#if defined(CONFIG_PASSINGLINK_INPUT_QUEUE)
+  InputQueueStats queue_stats = input_queue_get_stats();
+  result.queue_high_water = queue_stats.high_water;
+  result.queue_capacity = queue_stats.capacity;
+#endif
+
+  result.allocator_high_water = allocator_get_high_water();
+  return result;
+}
+
+static PLTelemetryLatency telemetry_get_latency() {
+  HistogramSummary latency = metrics_get_latency();
+  return {
+    .version = PLTelemetryLatency::kVersion,
+    .count = latency.count,
+    .min = latency.min,
+    .p50 = latency.p50,
+    .p90 = latency.p90,
+    .p99 = latency.p99,
+    .p999 = latency.p999,
+    .max = latency.max,
+  };
+}
+
+static PLTelemetryPoll telemetry_get_poll() {
+  PLTelemetryPoll result = {};
+  result.version = PLTelemetryPoll::kVersion;
+  if (hid) {
+    strncpy(result.backend, hid->Name(), sizeof(result.backend));
+  }
+  result.report_delay_us = hid_report_delay_us;
+  result.poll_interval_us = TELEMETRY_POLL_INTERVAL_US;
+
+  UsbPollStats stats = usb_hid_get_poll_stats();
+  result.intervals = stats.intervals;
+  result.interval_min_us = stats.interval_min_us;
+  result.interval_max_us = stats.interval_max_us;
+  result.jitter_p50_us = stats.jitter_us.p50;
+  result.jitter_p99_us = stats.jitter_us.p99;
+  result.jitter_p999_us = stats.jitter_us.p999;
+  result.jitter_max_us = stats.jitter_us.max;
+  result.missed_polls = stats.missed_polls;
+  result.write_failures = stats.write_failures;
+  result.requeues = stats.requeues;
+  result.max_failure_streak = stats.max_failure_streak;
+  return result;
+}
+
+static size_t telemetry_profile_index;
+
+static PLTelemetryProfile telemetry_get_profile(size_t idx) {
+  PLTelemetryProfile result = {};
+  result.version = PLTelemetryProfile::kVersion;
+  result.index = idx;
+  result.count = prof_site_count();
+
+  ProfSiteStats stats;
+  if (prof_site_get(idx, &stats)) {
+    strncpy(result.name, stats.name, sizeof(result.name));
+    result.cycles_per_second = get_cpu_freq();
+    result.calls = stats.calls;
+    result.total_cycles = stats.total;
+    result.min_cycles = stats.summary.min;
+    result.p50_cycles = stats.summary.p50;
+    result.p99_cycles = stats.summary.p99;
+    result.max_cycles = stats.summary.max;
+  }
+  return result;
+}
 
 static void write_report(struct k_work* item = nullptr);
 
@@ -61,24 +408,187 @@ struct k_work_q hid_work_q;
 K_THREAD_STACK_DEFINE(hid_work_q_stack, 2048);
 #endif
 
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER)
+static void submit_counter_work() {
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_WORK_QUEUE)
+  k_work_submit_to_queue(&hid_work_q, &counter_write_work);
+#else
+  k_work_submit(&counter_write_work);
+#endif
+}
+
+// Runs in interrupt context: hid_int_ep_write can't be called from here, so hand the write off
+// to the (maximum priority) work queue, which runs as soon as the interrupt returns.
+static void counter_write_alarm(const struct device*, uint8_t, uint32_t, void*) {
+  submit_counter_work();
+}
+
+static bool counter_submit_write(uint32_t delay_us) {
+  if (!write_counter) {
+    return false;
+  }
+
+  if (delay_us == 0) {
+    submit_counter_work();
+    return true;
+  }
+
+  struct counter_alarm_cfg alarm = {
+    .callback = counter_write_alarm,
+    .ticks = counter_us_to_ticks(write_counter, delay_us),
+    .user_data = nullptr,
+    .flags = 0,
+  };
+
+  counter_cancel_channel_alarm(write_counter, 0);
+  int rc = counter_set_channel_alarm(write_counter, 0, &alarm);
+  if (rc != 0) {
+    LOG_ERR("failed to set counter alarm, falling back to delayed work: rc = %d", rc);
+    counter_stop(write_counter);
+    write_counter = nullptr;
+    return false;
+  }
+  return true;
+}
+
+static void counter_init() {
+  write_counter = device_get_binding(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER_LABEL);
+  if (!write_counter) {
+    LOG_WRN("failed to find counter '%s', falling back to delayed work",
+            CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER_LABEL);
+    return;
+  }
+
+  if (counter_get_num_of_channels(write_counter) < 1) {
+    LOG_WRN("counter has no alarm channels, falling back to delayed work");
+    write_counter = nullptr;
+    return;
+  }
+
+  int rc = counter_start(write_counter);
+  if (rc != 0) {
+    LOG_WRN("failed to start counter, falling back to delayed work: rc = %d", rc);
+    write_counter = nullptr;
+  }
+}
+
+static void counter_uninit() {
+  if (write_counter) {
+    counter_cancel_channel_alarm(write_counter, 0);
+    counter_stop(write_counter);
+    write_counter = nullptr;
+  }
+}
+#else
+static bool counter_submit_write(uint32_t delay_us) {
+  return false;
+}
+#endif
+
 #if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED)
-static void submit_write() {
-  {
-    ScopedIRQLock lock;
+// Schedule a write delay_us from now. Safe to call from interrupt context.
+static void schedule_write(uint32_t delay_us) {
+  ScopedIRQLock lock;
+  if (!counter_submit_write(delay_us)) {
 #if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_WORK_QUEUE)
-    k_delayed_work_submit_to_queue(&hid_work_q, &delayed_write_work,
-                                   K_TICKS(hid_report_delay_ticks));
+    k_delayed_work_submit_to_queue(&hid_work_q, &delayed_write_work, K_USEC(delay_us));
 #else
-    k_delayed_work_submit(&delayed_write_work, K_TICKS(hid_report_delay_ticks));
+    k_delayed_work_submit(&delayed_write_work, K_USEC(delay_us));
 #endif
   }
+}
+
+static void submit_write() {
+  schedule_write(hid_report_delay_us);
 
   // Immediately do a touchpad read after submitting, since it's slow.
   input_touchpad_poll();
 }
 #endif
 
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+// Phase lock report generation to the host's frame clock: instead of delaying from when the
+// host read the previous report (which is only approximately periodic), schedule the write
+// CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC_OFFSET_US after the start of the next frame.
+//
+// This is a different reference point from hid_report_delay_us, which is tuned for the time
+// between the host's read and its next poll: the host may poll early in the frame, so the offset
+// from the start of frame has to be small to avoid missing every other poll.
+static bool sof_write_pending;
+static optional<uint32_t> sof_last_cycle;
+static UsbSofStats sof_stats;
+
+// Gaps longer than this are treated as a suspend (or similar), not as missed frames.
+static constexpr uint32_t SOF_RESYNC_FRAMES = 16;
+
+// Frames are timed with the input clock, since the core may sleep between them.
+static uint32_t sof_frame_cycles() {
+  return k_ms_to_cyc_floor32(1);
+}
+
+// Whether we're actually receiving SOF events: if not, fall back to writing immediately.
+static bool sof_active() {
+  return sof_last_cycle && input_clock_sample() - *sof_last_cycle < 2 * sof_frame_cycles();
+}
+
+static void sof_reset() {
+  ScopedIRQLock lock;
+  sof_last_cycle.reset();
+}
+
+static void sof_record(uint32_t now) {
+  if (sof_last_cycle) {
+    uint32_t frame_cycles = sof_frame_cycles();
+    uint32_t interval = now - *sof_last_cycle;
+    if (interval < frame_cycles / 2) {
+      ++sof_stats.duplicated;
+    } else if (interval > frame_cycles * 3 / 2) {
+      uint32_t frames = (interval + frame_cycles / 2) / frame_cycles;
+      if (frames < SOF_RESYNC_FRAMES) {
+        sof_stats.missed += frames - 1;
+      }
+    }
+  }
+
+  ++sof_stats.frames;
+  sof_last_cycle = now;
+}
+
+// The touchpad read that submit_write does inline, which is too slow for sof_handle.
+static void sof_touchpad_poll(struct k_work*) {
+  input_touchpad_poll();
+}
+
+K_WORK_DEFINE(sof_touchpad_work, sof_touchpad_poll);
+
+// Called from the USB interrupt: only schedule work from here.
+static void sof_handle() {
+  bool pending;
+  {
+    ScopedIRQLock lock;
+    sof_record(input_clock_sample());
+    pending = sof_write_pending;
+    sof_write_pending = false;
+  }
+
+  if (pending) {
+    schedule_write(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC_OFFSET_US);
+    k_work_submit(&sof_touchpad_work);
+  }
+}
+#endif
+
 static void do_write() {
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+  {
+    ScopedIRQLock lock;
+    if (sof_active()) {
+      sof_write_pending = true;
+      return;
+    }
+  }
+#endif
+
 #if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED)
   submit_write();
 #else
@@ -91,39 +601,36 @@ static void write_report(struct k_work* item) {
 
   uint8_t report_buf[64];
 
-  ssize_t report_size;
-  {
-    PROFILE("Hid::GetReport", 128);
-
-    report_size = hid->GetReport(HidReportType::Input, 1, span(report_buf, sizeof(report_buf)));
-    if (report_size < 0) {
-      return;
-    }
+  // Timed for PLTelemetry, rather than with PROFILE, so that it's available without profiling.
+  TRACE(ReportEncodeBegin, 0);
+  uint32_t begin = get_cycle_count();
+  ssize_t report_size = hid->GetInterruptReport(span(report_buf, sizeof(report_buf)));
+  telemetry_record_get_report(get_cycle_count() - begin);
+  TRACE(ReportEncodeEnd, report_size);
+  if (report_size < 0) {
+    return;
   }
 
   size_t bytes_written = 0;
+  TRACE(UsbWriteBegin, 0);
   int rc = hid_int_ep_write(usb_hid_device, report_buf, report_size, &bytes_written);
+  TRACE(UsbWriteEnd, rc);
+  telemetry_written(rc >= 0);
   if (rc < 0) {
+    report_delay_tune_backoff();
 #if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED)
     LOG_ERR("USB write failed, requeuing: rc = %d", rc);
     submit_write();
 #else
     return write_report(item);
 #endif
-  } else if (bytes_written != static_cast<size_t>(report_size)) {
-    LOG_WRN("wrote fewer bytes (%d) than expected (%d): buffer full?", bytes_written, report_size);
-  }
-
-#if defined(INTERVAL_PROFILING)
-  static uint32_t previous;
-  uint32_t now = get_cycle_count();
-  uint32_t diff = now - previous;
-  previous = now;
-
-  if (diff > 100'000 && diff < 72'000'000) {
-    LOG_ERR("interval between writes too long: %d cycles", diff);
+  } else {
+    report_delay_tune_written();
+    if (bytes_written != static_cast<size_t>(report_size)) {
+      LOG_WRN("wrote fewer bytes (%d) than expected (%d): buffer full?", bytes_written,
+              report_size);
+    }
   }
-#endif
 }
 
 static void usb_status_cb(enum usb_dc_status_code status, const uint8_t* param) {
@@ -145,6 +652,13 @@ static void usb_status_cb(enum usb_dc_status_code status, const uint8_t* param)
       break;
     case USB_DC_SUSPEND:
       LOG_INF("USB_DC_SUSPEND");
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+      sof_reset();
+#endif
+      {
+        ScopedIRQLock lock;
+        telemetry_ready_cycle.reset();
+      }
       suspend_timestamp.reset(k_uptime_get());
       break;
     case USB_DC_RESUME:
@@ -180,7 +694,14 @@ static void usb_status_cb(enum usb_dc_status_code status, const uint8_t* param)
       }
       break;
     case USB_DC_SOF:
+#if defined(CONFIG_PASSINGLINK_INPUT_QUEUE_FRAME_CLOCK)
+      input_queue_frame();
+#endif
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+      sof_handle();
+#elif !defined(CONFIG_PASSINGLINK_INPUT_QUEUE_FRAME_CLOCK)
       LOG_INF("USB_DC_SOF");
+#endif
       break;
     case USB_DC_UNKNOWN:
       LOG_INF("USB_DC_UNKNOWN");
@@ -298,7 +819,10 @@ static const struct hid_ops ops = {
     },
   .int_in_ready =
     [](const struct device*) {
+      TRACE(IntInReady, 0);
       metrics_record_usb_write();
+      telemetry_ready();
+      report_delay_tune_ready();
       do_write();
     },
   .int_out_ready =
@@ -314,6 +838,10 @@ static const struct hid_ops ops = {
     },
 };
 
+#if defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+static size_t recording_offset;
+#endif
+
 optional<ssize_t> Hid::GetReportPL(optional<HidReportType> report_type, uint8_t report_id,
                                    span<uint8_t> buf) {
 
@@ -337,6 +865,45 @@ optional<ssize_t> Hid::GetReportPL(optional<HidReportType> report_type, uint8_t
         return 1;
     }
 
+    case PLReportId::Telemetry: {
+      PLTelemetry telemetry = telemetry_get();
+      size_t len = min(buf.size(), sizeof(telemetry));
+      memcpy(buf.data(), &telemetry, len);
+      return len;
+    }
+
+    case PLReportId::TelemetryLatency: {
+      PLTelemetryLatency latency = telemetry_get_latency();
+      size_t len = min(buf.size(), sizeof(latency));
+      memcpy(buf.data(), &latency, len);
+      return len;
+    }
+
+    case PLReportId::TelemetryPoll: {
+      PLTelemetryPoll poll = telemetry_get_poll();
+      size_t len = min(buf.size(), sizeof(poll));
+      memcpy(buf.data(), &poll, len);
+      return len;
+    }
+
+    case PLReportId::TelemetryProfile: {
+      PLTelemetryProfile profile = telemetry_get_profile(telemetry_profile_index);
+      if (++telemetry_profile_index >= profile.count) {
+        telemetry_profile_index = 0;
+      }
+      size_t len = min(buf.size(), sizeof(profile));
+      memcpy(buf.data(), &profile, len);
+      return len;
+    }
+
+#if defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+    case PLReportId::ReadRecording: {
+      size_t len = input_record_export(recording_offset, buf);
+      recording_offset += len;
+      return len;
+    }
+#endif
+
     default:
       return {};
   }
@@ -391,6 +958,74 @@ optional<bool> Hid::SetReportPL(optional<HidReportType> report_type, uint8_t rep
       }
 #endif
 
+#if defined(CONFIG_PASSINGLINK_INPUT_CUSTOM_PROFILES)
+      case PLReportId::WriteProfiles: {
+        if (data.size() < 2) {
+          return false;
+        }
+
+        size_t offset = data.data()[1];
+        offset *= 62;
+
+        return input_profile_write(data.data() + 2, data.size() - 2, offset);
+      }
+
+      case PLReportId::FlushProfiles: {
+        uint32_t magic;
+        if (data.size() != 5) {
+          LOG_ERR("FlushProfiles: invalid data size %zu", data.size());
+          return false;
+        }
+        memcpy(&magic, data.data() + 1, sizeof(magic));
+        if (magic != static_cast<uint32_t>(CustomProfileVersion::V1)) {
+          LOG_ERR("FlushProfiles: magic mismatch, received 0x%x", magic);
+          return false;
+        }
+
+        return input_profile_flush();
+      }
+#endif
+
+      case PLReportId::Telemetry: {
+        uint32_t magic;
+        if (data.size() != 5) {
+          LOG_ERR("Telemetry: invalid data size %zu", data.size());
+          return false;
+        }
+        memcpy(&magic, data.data() + 1, sizeof(magic));
+        if (magic != PLTelemetry::kResetMagic) {
+          LOG_ERR("Telemetry: magic mismatch, received 0x%x", magic);
+          return false;
+        }
+
+        telemetry_reset();
+        metrics_reset();
+        prof_site_reset();
+        return true;
+      }
+
+      case PLReportId::TelemetryProfile: {
+        if (data.size() != 2) {
+          LOG_ERR("TelemetryProfile: invalid data size %zu", data.size());
+          return false;
+        }
+        telemetry_profile_index = data[1];
+        return true;
+      }
+
+#if defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+      case PLReportId::ReadRecording: {
+        uint32_t offset;
+        if (data.size() != 5) {
+          LOG_ERR("ReadRecording: invalid data size %zu", data.size());
+          return false;
+        }
+        memcpy(&offset, data.data() + 1, sizeof(offset));
+        recording_offset = offset;
+        return true;
+      }
+#endif
+
       default:
         return {};
     }
@@ -399,15 +1034,67 @@ optional<bool> Hid::SetReportPL(optional<HidReportType> report_type, uint8_t rep
   return {};
 }
 
+UsbPollStats usb_hid_get_poll_stats() {
+  UsbPollStats result = {};
+  ScopedIRQLock lock;
+  result.intervals = telemetry_poll_intervals;
+  result.interval_min_us = telemetry_poll_intervals ? telemetry_poll_interval_min_us : 0;
+  result.interval_max_us = telemetry_poll_interval_max_us;
+  result.jitter_us = telemetry_poll_jitter.summarize();
+  result.missed_polls = telemetry_poll_missed_polls;
+  result.write_failures = telemetry_poll_write_failures;
+  result.requeues = telemetry_requeues;
+  result.max_failure_streak = telemetry_max_failure_streak;
+  return result;
+}
+
+size_t usb_hid_get_poll_events(span<UsbPollEvent> out) {
+  ScopedIRQLock lock;
+  size_t count = min(telemetry_poll_event_count, ARRAY_SIZE(telemetry_poll_events));
+  count = min(count, out.size());
+  size_t first = telemetry_poll_event_count - count;
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = telemetry_poll_events[(first + i) % ARRAY_SIZE(telemetry_poll_events)];
+  }
+  return count;
+}
+
+void usb_hid_reset_poll_stats() {
+  ScopedIRQLock lock;
+  telemetry_poll_reset();
+  telemetry_poll_event_count = 0;
+}
+
 #if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED)
-uint32_t usb_hid_get_report_delay_ticks() {
-  return hid_report_delay_ticks;
+uint32_t usb_hid_get_report_delay_us() {
+  return hid_report_delay_us;
 }
 
-void usb_hid_set_report_delay_ticks(uint32_t ticks) {
-  hid_report_delay_ticks = ticks;
+void usb_hid_set_report_delay_us(uint32_t us) {
+  ScopedIRQLock lock;
+  hid_report_delay_us = us;
 }
 
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+UsbSofStats usb_hid_get_sof_stats() {
+  ScopedIRQLock lock;
+  return sof_stats;
+}
+#endif
+
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+bool usb_hid_get_report_delay_auto() {
+  return report_delay_auto;
+}
+
+void usb_hid_set_report_delay_auto(bool enabled) {
+  ScopedIRQLock lock;
+  report_delay_auto = enabled;
+  report_delay_tune_hold = 0;
+  report_delay_tune_reset_window();
+}
+#endif
+
 #endif
 namespace passinglink {
 
@@ -425,6 +1112,11 @@ int usb_hid_init(Hid* hid_impl) {
   k_delayed_work_init(&delayed_write_work, write_report);
 #endif
 
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER)
+  k_work_init(&counter_write_work, write_report);
+  counter_init();
+#endif
+
   hid = hid_impl;
 
   LOG_INF("initializing USB HID as %s", hid->Name());
@@ -459,6 +1151,10 @@ int usb_hid_init(Hid* hid_impl) {
 }
 
 void usb_hid_uninit() {
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER)
+  counter_uninit();
+#endif
+
 #if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED)
   k_delayed_work_cancel(&delayed_write_work);
 #endif
@@ -468,6 +1164,7 @@ void usb_hid_uninit() {
   hid->Deinit();
 
   metrics_reset();
+  telemetry_reset();
 }
 
 }  // namespace passinglink
@@ -2,6 +2,7 @@
 
 #include <sys/types.h>
 
+#include "metrics/histogram.h"
 #include "types.h"
 
 enum class HidReportType {
@@ -36,9 +37,141 @@ enum class PLReportId : uint8_t {
   // };
   FlushProvisioning = 0x44,
 
+  // Read the input recording (see input/record.h), up to 63 bytes at a time.
+  // Reads continue from the previous one, and setting the report seeks:
+  // struct {
+  //   uint32_t offset; // in bytes
+  // };
+  ReadRecording = 0x45,
+
+  // Write part of CustomProfileData (see input/profile_types.h) into a temporary.
+  // struct {
+  //   uint8_t offset; // in multiples of 62 bytes
+  //   uint8_t data[62];
+  // };
+  WriteProfiles = 0x46,
+
+  // Flush accumulated writes from WriteProfiles to flash, and load them.
+  // struct {
+  //   uint32_t magic; // 0x1209214e
+  // };
+  FlushProfiles = 0x47,
+
+  // Read USB telemetry, as a PLTelemetry.
+  // Setting the report resets telemetry, metrics and profiles:
+  // struct {
+  //   uint32_t magic; // 0x1209214f
+  // };
+  Telemetry = 0x48,
+
+  // Read the input to USB write latency, as a PLTelemetryLatency.
+  TelemetryLatency = 0x49,
+
+  // Read a profiled site (see profiling.h), as a PLTelemetryProfile.
+  // Reads advance to the next site, and setting the report seeks:
+  // struct {
+  //   uint8_t index;
+  // };
+  TelemetryProfile = 0x4a,
+
+  // Read USB poll statistics, as a PLTelemetryPoll.
+  TelemetryPoll = 0x4b,
+
   PS4Auth = 0xf0,
 };
 
+// All fields are little-endian, and counted since the last reset.
+struct __attribute__((packed)) PLTelemetry {
+  static constexpr uint8_t kVersion = 1;
+  static constexpr uint32_t kResetMagic = 0x1209214f;
+
+  uint8_t version;
+
+  // Reports handed to the hardware, and calls to hid_int_ep_write that failed.
+  uint32_t reports;
+  uint32_t write_failures;
+
+  // Host polls that we didn't have a report ready for.
+  uint32_t missed_polls;
+
+  // Time spent building reports (in Hid::GetReport).
+  uint32_t get_report_avg_ns;
+  uint32_t get_report_max_ns;
+
+  uint32_t report_delay_us;
+
+  // Most of the input queue and allocator that have been in use at once, in bytes.
+  uint32_t queue_high_water;
+  uint32_t queue_capacity;
+  uint32_t allocator_high_water;
+};
+
+struct __attribute__((packed)) PLTelemetryLatency {
+  static constexpr uint8_t kVersion = 1;
+
+  uint8_t version;
+  uint32_t count;
+
+  // In microseconds.
+  uint32_t min;
+  uint32_t p50;
+  uint32_t p90;
+  uint32_t p99;
+  uint32_t p999;
+  uint32_t max;
+};
+
+struct __attribute__((packed)) PLTelemetryProfile {
+  static constexpr uint8_t kVersion = 1;
+
+  uint8_t version;
+  uint8_t index;
+
+  // Number of profiled sites. If index is past the end, the rest of the report is zeroed.
+  uint8_t count;
+
+  // Truncated, and NUL-terminated if shorter than the field.
+  char name[20];
+
+  uint32_t cycles_per_second;
+  uint32_t calls;
+  uint64_t total_cycles;
+
+  // Of the most recent calls (see ProfileSite::kSampleCount).
+  uint32_t min_cycles;
+  uint32_t p50_cycles;
+  uint32_t p99_cycles;
+  uint32_t max_cycles;
+};
+
+struct __attribute__((packed)) PLTelemetryPoll {
+  static constexpr uint8_t kVersion = 1;
+
+  uint8_t version;
+
+  // Hid::Name of the active backend, truncated, and NUL-terminated if shorter than the field.
+  char backend[8];
+  uint32_t report_delay_us;
+  uint32_t poll_interval_us;
+
+  // Intervals between int_in_ready calls, in microseconds, and how far they were from
+  // poll_interval_us.
+  uint32_t intervals;
+  uint32_t interval_min_us;
+  uint32_t interval_max_us;
+  uint32_t jitter_p50_us;
+  uint32_t jitter_p99_us;
+  uint32_t jitter_p999_us;
+  uint32_t jitter_max_us;
+
+  uint32_t missed_polls;
+  uint32_t write_failures;
+
+  // Failed writes that were themselves a retry of a failed write, and the longest run of failures.
+  uint32_t requeues;
+  uint32_t max_failure_streak;
+};
+
 #define PL_HID_REPORT_DESCRIPTOR                               \
   0x06, 0x42, 0xFF,   /* Usage Page (Vendor Defined 0xFF42) */ \
     0x09, 0x01,       /* Usage (0x01) */                       \
@@ -60,6 +193,27 @@ enum class PLReportId : uint8_t {
     0x85, 0x44,       /*   Report ID (68) */                   \
     0x0A, 0x44, 0x42, /*   Usage (0x4244) */                   \
     0xB1, 0x02,       /*   Feature(...) */                     \
+    0x85, 0x45,       /*   Report ID (69) */                   \
+    0x0A, 0x45, 0x42, /*   Usage (0x4245) */                   \
+    0xB1, 0x02,       /*   Feature(...) */                     \
+    0x85, 0x46,       /*   Report ID (70) */                   \
+    0x0A, 0x46, 0x42, /*   Usage (0x4246) */                   \
+    0xB1, 0x02,       /*   Feature(...) */                     \
+    0x85, 0x47,       /*   Report ID (71) */                   \
+    0x0A, 0x47, 0x42, /*   Usage (0x4247) */                   \
+    0xB1, 0x02,       /*   Feature(...) */                     \
+    0x85, 0x48,       /*   Report ID (72) */                   \
+    0x0A, 0x48, 0x42, /*   Usage (0x4248) */                   \
+    0xB1, 0x02,       /*   Feature(...) */                     \
+    0x85, 0x49,       /*   Report ID (73) */                   \
+    0x0A, 0x49, 0x42, /*   Usage (0x4249) */                   \
+    0xB1, 0x02,       /*   Feature(...) */                     \
+    0x85, 0x4A,       /*   Report ID (74) */                   \
+    0x0A, 0x4A, 0x42, /*   Usage (0x424A) */                   \
+    0xB1, 0x02,       /*   Feature(...) */                     \
+    0x85, 0x4B,       /*   Report ID (75) */                   \
+    0x0A, 0x4B, 0x42, /*   Usage (0x424B) */                   \
+    0xB1, 0x02,       /*   Feature(...) */                     \
     0xC0,             /* End Collection */
 
 class Hid {
@@ -83,6 +237,13 @@ class Hid {
     return false;
   }
 
+  // Build the input report for the interrupt endpoint. Unlike GetReport, which is also called for
+  // control transfers, this is only called from the write path, which never runs concurrently
+  // with itself, so implementations can keep state across calls without locking.
+  virtual ssize_t GetInterruptReport(span<uint8_t> buf) {
+    return GetReport(HidReportType::Input, 1, buf);
+  }
+
   virtual void InterruptOut(span<uint8_t> data) {}
 
   virtual void ClearHalt(uint8_t endpoint) {}
@@ -91,8 +252,74 @@ class Hid {
   virtual bool ProbeResult() { return false; }
 };
 
-uint32_t usb_hid_get_report_delay_ticks();
-void usb_hid_set_report_delay_ticks(uint32_t ticks);
+// Delay between the host reading a report and us building the next one.
+uint32_t usb_hid_get_report_delay_us();
+void usb_hid_set_report_delay_us(uint32_t us);
+
+// Granularity at which the report delay is actually scheduled.
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_DEFERRED_COUNTER)
+constexpr uint32_t USB_HID_REPORT_DELAY_STEP_US = 10;
+#else
+constexpr uint32_t USB_HID_REPORT_DELAY_STEP_US = k_ticks_to_us_ceil32(1);
+#endif
+
+// How regularly the host reads reports, and how often writing them fails.
+struct UsbPollStats {
+  // Intervals between the host reading reports, in microseconds: jitter is the distance from the
+  // configured polling interval. Gaps long enough to be a suspend aren't counted.
+  uint32_t intervals;
+  uint32_t interval_min_us;
+  uint32_t interval_max_us;
+  HistogramSummary jitter_us;
+
+  uint32_t missed_polls;
+  uint32_t write_failures;
+  uint32_t requeues;
+  uint32_t max_failure_streak;
+};
+
+enum class UsbPollEventType : uint8_t {
+  // count is the number of polls missed.
+  MissedPoll,
+
+  // count is the number of consecutive failed writes.
+  Requeue,
+};
+
+// Missed polls and runs of failed writes, with the backend and report delay they happened with,
+// so that problems can be traced back to a particular console, hub or cable. Unlike the other
+// statistics, these are kept when the backend changes.
+struct UsbPollEvent {
+  uint32_t uptime_ms;
+  const char* backend;
+  uint32_t report_delay_us;
+  UsbPollEventType type;
+  uint32_t count;
+};
+
+UsbPollStats usb_hid_get_poll_stats();
+
+// Copy out the most recent events, oldest first, returning the number copied.
+size_t usb_hid_get_poll_events(span<UsbPollEvent> out);
+
+// Reset the poll statistics and events. PLTelemetry has its own counters, which aren't affected.
+void usb_hid_reset_poll_stats();
+
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+struct UsbSofStats {
+  uint32_t frames;
+  uint32_t missed;
+  uint32_t duplicated;
+};
+
+UsbSofStats usb_hid_get_sof_stats();
+#endif
+
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_AUTO_DELAY)
+// Automatically tune the report delay to be as close to the host's polling as possible.
+bool usb_hid_get_report_delay_auto();
+void usb_hid_set_report_delay_auto(bool enabled);
+#endif
 
 namespace passinglink {
 int usb_hid_init(Hid* hid_impl);
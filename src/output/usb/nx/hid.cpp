@@ -12,6 +12,7 @@
 
 #include "input/input.h"
 #include "output/usb/hid.h"
+#include "output/usb/report.h"
 #include "types.h"
 
 #define LOG_LEVEL LOG_LEVEL_INF
@@ -66,24 +67,8 @@ const uint8_t kNXReportDescriptor[] = {
 // clang-format on
 
 struct __attribute__((packed)) OutputReport {
-  uint16_t button_west : 1;
-  uint16_t button_south : 1;
-  uint16_t button_east : 1;
-  uint16_t button_north : 1;
-  uint16_t button_l1 : 1;
-  uint16_t button_r1 : 1;
-  uint16_t button_l2 : 1;
-  uint16_t button_r2 : 1;
-  uint16_t button_select : 1;
-  uint16_t button_start : 1;
-  uint16_t button_l3 : 1;
-  uint16_t button_r3 : 1;
-  uint16_t button_home : 1;
-  uint16_t button_touchpad : 1;
-  uint16_t button_15 : 1;
-  uint16_t button_16 : 1;
-  uint8_t dpad : 4;
-  uint8_t unknown_1 : 4;
+  // 16 bits for buttons, 4 bits for the d-pad, and 4 unknown bits (see kNXReportLayout).
+  uint8_t buttons[3];
   uint8_t left_stick_x;
   uint8_t left_stick_y;
   uint8_t right_stick_x;
@@ -93,6 +78,21 @@ struct __attribute__((packed)) OutputReport {
 
 static_assert(sizeof(OutputReport) == 8);
 
+static constexpr ReportLayout kNXReportLayout = {
+  .hat_shift = 16,
+  .hat_neutral = 8,
+  .buttons = {
+    // north, east, south, west
+    3, 2, 1, 0,
+    // l1, l2, l3, r1, r2, r3
+    4, 6, 10, 5, 7, 11,
+    // select, start, home, touchpad
+    8, 9, 12, 13,
+  },
+};
+
+static constexpr ReportEncoder kNXReportEncoder(kNXReportLayout);
+
 int NXHid::Init() {
   usb_set_vendor_id(0x0f0d);
   usb_set_product_id(0x0092);
@@ -115,7 +115,27 @@ ssize_t NXHid::GetFeatureReport(uint8_t report_id, span<uint8_t> buf) {
   return -1;
 }
 
-ssize_t NXHid::GetInputReport(uint8_t report_id, span<uint8_t> buf) {
+// Encode the parts of an input report that only depend on the InputState.
+static bool encode_input_report(const InputState& input, OutputReport* output) {
+  *output = {};
+  output->left_stick_x = input.left_stick_x;
+  output->left_stick_y = input.left_stick_y;
+  output->right_stick_x = input.right_stick_x;
+  output->right_stick_y = input.right_stick_y;
+
+  optional<uint32_t> buttons = kNXReportEncoder.encode(input);
+  if (!buttons) {
+    LOG_ERR("invalid stick state: %d", static_cast<int>(input.dpad));
+    return false;
+  }
+  memcpy(output->buttons, &*buttons, sizeof(output->buttons));
+  return true;
+}
+
+// Only used for interrupt reports.
+static CachedReport<OutputReport> cached_report;
+
+ssize_t NXHid::GetInputReport(uint8_t report_id, span<uint8_t> buf, bool interrupt) {
   switch (report_id) {
     case 0x01: {
       if (buf.size() != 64) {
@@ -129,61 +149,19 @@ ssize_t NXHid::GetInputReport(uint8_t report_id, span<uint8_t> buf) {
         return -1;
       }
 
-      OutputReport output = {};
-      output.left_stick_x = input.left_stick_x;
-      output.left_stick_y = input.left_stick_y;
-      output.right_stick_x = input.right_stick_x;
-      output.right_stick_y = input.right_stick_y;
-      switch (static_cast<StickState>(input.dpad)) {
-        case StickState::North:
-          output.dpad = 0;
-          break;
-        case StickState::NorthEast:
-          output.dpad = 1;
-          break;
-        case StickState::East:
-          output.dpad = 2;
-          break;
-        case StickState::SouthEast:
-          output.dpad = 3;
-          break;
-        case StickState::South:
-          output.dpad = 4;
-          break;
-        case StickState::SouthWest:
-          output.dpad = 5;
-          break;
-        case StickState::West:
-          output.dpad = 6;
-          break;
-        case StickState::NorthWest:
-          output.dpad = 7;
-          break;
-        case StickState::Neutral:
-          output.dpad = 8;
-          break;
-        default:
-          LOG_ERR("invalid stick state: %d", static_cast<int>(input.dpad));
+      OutputReport local;
+      OutputReport* output = &local;
+      if (interrupt) {
+        output = cached_report.get(input, encode_input_report);
+        if (!output) {
           return -1;
+        }
+      } else if (!encode_input_report(input, output)) {
+        return -1;
       }
 
-      output.button_north = input.button_north;
-      output.button_east = input.button_east;
-      output.button_south = input.button_south;
-      output.button_west = input.button_west;
-      output.button_l1 = input.button_l1;
-      output.button_l2 = input.button_l2;
-      output.button_l3 = input.button_l3;
-      output.button_r1 = input.button_r1;
-      output.button_r2 = input.button_r2;
-      output.button_r3 = input.button_r3;
-      output.button_select = input.button_select;
-      output.button_start = input.button_start;
-      output.button_home = input.button_home;
-      output.button_touchpad = input.button_touchpad;
-
-      memcpy(buf.data(), &output, sizeof(output));
-      return sizeof(output);
+      memcpy(buf.data(), output, sizeof(*output));
+      return sizeof(*output);
     }
 
     default:
@@ -201,7 +179,7 @@ ssize_t NXHid::GetReport(optional<HidReportType> report_type, uint8_t report_id,
   } else if (*report_type == HidReportType::Feature) {
     return GetFeatureReport(report_id, buf);
   } else if (*report_type == HidReportType::Input) {
-    return GetInputReport(report_id, buf);
+    return GetInputReport(report_id, buf, false);
   } else if (*report_type == HidReportType::Output) {
     LOG_ERR("ignoring GetReport on output report %d", static_cast<int>(*report_type));
     return -1;
@@ -15,9 +15,12 @@ class NXHid : public Hid {
 
   virtual span<const uint8_t> ReportDescriptor() const override final;
   ssize_t GetFeatureReport(uint8_t report_id, span<uint8_t> buf);
-  ssize_t GetInputReport(uint8_t report_id, span<uint8_t> buf);
+  ssize_t GetInputReport(uint8_t report_id, span<uint8_t> buf, bool interrupt);
   virtual ssize_t GetReport(optional<HidReportType> report_type, uint8_t report_id,
                             span<uint8_t> buf) override final;
+  virtual ssize_t GetInterruptReport(span<uint8_t> buf) override final {
+    return GetInputReport(0x01, buf, true);
+  }
 
   virtual void ClearHalt(uint8_t endpoint) override final {
     if (endpoint & 0x80) {
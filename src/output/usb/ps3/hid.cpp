@@ -13,6 +13,7 @@
 #include "input/input.h"
 #include "output/led.h"
 #include "output/usb/hid.h"
+#include "output/usb/report.h"
 #include "types.h"
 
 #define LOG_LEVEL LOG_LEVEL_INF
@@ -91,22 +92,9 @@ const uint8_t kPS3ReportDescriptor[] = {
 // clang-format on
 
 struct __attribute__((packed)) OutputReport {
-  uint16_t button_west : 1;
-  uint16_t button_south : 1;
-  uint16_t button_east : 1;
-  uint16_t button_north : 1;
-  uint16_t button_l1 : 1;
-  uint16_t button_r1 : 1;
-  uint16_t button_l2 : 1;
-  uint16_t button_r2 : 1;
-  uint16_t button_select : 1;
-  uint16_t button_start : 1;
-  uint16_t button_l3 : 1;
-  uint16_t button_r3 : 1;
-  uint16_t button_home : 1;
-  uint16_t padding_1 : 3;
-  uint8_t dpad : 4;
-  uint8_t padding_2 : 4;
+  // 13 bits for buttons, 3 bits of padding, 4 bits for the d-pad, and 4 more bits of padding
+  // (see kPS3ReportLayout).
+  uint8_t buttons[3];
   uint8_t left_stick_x;
   uint8_t left_stick_y;
   uint8_t right_stick_x;
@@ -123,6 +111,21 @@ struct __attribute__((packed)) OutputReport {
 
 static_assert(sizeof(OutputReport) == 27);
 
+static constexpr ReportLayout kPS3ReportLayout = {
+  .hat_shift = 16,
+  .hat_neutral = 8,
+  .buttons = {
+    // north, east, south, west
+    3, 2, 1, 0,
+    // l1, l2, l3, r1, r2, r3
+    4, 6, 10, 5, 7, 11,
+    // select, start, home, touchpad
+    8, 9, 12, -1,
+  },
+};
+
+static constexpr ReportEncoder kPS3ReportEncoder(kPS3ReportLayout);
+
 span<const uint8_t> PS3Hid::ReportDescriptor() const {
   return span<const uint8_t>(reinterpret_cast<const uint8_t*>(kPS3ReportDescriptor),
                              sizeof(kPS3ReportDescriptor));
@@ -143,7 +146,33 @@ ssize_t PS3Hid::GetFeatureReport(uint8_t report_id, span<uint8_t> buf) {
   return -1;
 }
 
-ssize_t PS3Hid::GetInputReport(uint8_t report_id, span<uint8_t> buf) {
+// Encode the parts of an input report that only depend on the InputState.
+static bool encode_input_report(const InputState& input, OutputReport* output) {
+  *output = {};
+  output->left_stick_x = input.left_stick_x;
+  output->left_stick_y = input.left_stick_y;
+  output->right_stick_x = input.right_stick_x;
+  output->right_stick_y = input.right_stick_y;
+
+  optional<uint32_t> buttons = kPS3ReportEncoder.encode(input);
+  if (!buttons) {
+    LOG_ERR("invalid stick state: %d", static_cast<int>(input.dpad));
+    return false;
+  }
+  memcpy(output->buttons, &*buttons, sizeof(output->buttons));
+
+  // ???
+  output->two_1 = 0x02;
+  output->two_2 = 0x02;
+  output->two_3 = 0x02;
+  output->two_4 = 0x02;
+  return true;
+}
+
+// Only used for interrupt reports.
+static CachedReport<OutputReport> cached_report;
+
+ssize_t PS3Hid::GetInputReport(uint8_t report_id, span<uint8_t> buf, bool interrupt) {
   switch (report_id) {
     case 0x01: {
       if (buf.size() != 64) {
@@ -157,66 +186,19 @@ ssize_t PS3Hid::GetInputReport(uint8_t report_id, span<uint8_t> buf) {
         return -1;
       }
 
-      OutputReport output = {};
-      output.left_stick_x = input.left_stick_x;
-      output.left_stick_y = input.left_stick_y;
-      output.right_stick_x = input.right_stick_x;
-      output.right_stick_y = input.right_stick_y;
-      switch (static_cast<StickState>(input.dpad)) {
-        case StickState::North:
-          output.dpad = 0;
-          break;
-        case StickState::NorthEast:
-          output.dpad = 1;
-          break;
-        case StickState::East:
-          output.dpad = 2;
-          break;
-        case StickState::SouthEast:
-          output.dpad = 3;
-          break;
-        case StickState::South:
-          output.dpad = 4;
-          break;
-        case StickState::SouthWest:
-          output.dpad = 5;
-          break;
-        case StickState::West:
-          output.dpad = 6;
-          break;
-        case StickState::NorthWest:
-          output.dpad = 7;
-          break;
-        case StickState::Neutral:
-          output.dpad = 8;
-          break;
-        default:
-          LOG_ERR("invalid stick state: %d", static_cast<int>(input.dpad));
+      OutputReport local;
+      OutputReport* output = &local;
+      if (interrupt) {
+        output = cached_report.get(input, encode_input_report);
+        if (!output) {
           return -1;
+        }
+      } else if (!encode_input_report(input, output)) {
+        return -1;
       }
 
-      output.button_north = input.button_north;
-      output.button_east = input.button_east;
-      output.button_south = input.button_south;
-      output.button_west = input.button_west;
-      output.button_l1 = input.button_l1;
-      output.button_l2 = input.button_l2;
-      output.button_l3 = input.button_l3;
-      output.button_r1 = input.button_r1;
-      output.button_r2 = input.button_r2;
-      output.button_r3 = input.button_r3;
-      output.button_select = input.button_select;
-      output.button_start = input.button_start;
-      output.button_home = input.button_home;
-
-      // ???
-      output.two_1 = 0x02;
-      output.two_2 = 0x02;
-      output.two_3 = 0x02;
-      output.two_4 = 0x02;
-
-      memcpy(buf.data(), &output, sizeof(output));
-      return sizeof(output);
+      memcpy(buf.data(), output, sizeof(*output));
+      return sizeof(*output);
     }
 
     default:
@@ -234,7 +216,7 @@ ssize_t PS3Hid::GetReport(optional<HidReportType> report_type, uint8_t report_id
   } else if (*report_type == HidReportType::Feature) {
     return GetFeatureReport(report_id, buf);
   } else if (*report_type == HidReportType::Input) {
-    return GetInputReport(report_id, buf);
+    return GetInputReport(report_id, buf, false);
   } else if (*report_type == HidReportType::Output) {
     LOG_ERR("ignoring GetReport on output report %d", static_cast<int>(*report_type));
     return -1;
@@ -11,14 +11,13 @@
 #include <mbedtls/rsa.h>
 #include <mbedtls/sha256.h>
 
+#include "malloc.h"
 #include "panic.h"
 #include "provisioning.h"
 
 #define LOG_LEVEL LOG_LEVEL_INF
 LOG_MODULE_REGISTER(PS4Auth);
 
-extern "C" void dump_allocator_hwm();
-
 #if defined(CONFIG_PASSINGLINK_CHECK_MAIN_STACK_HWM)
 extern "C" K_THREAD_STACK_DEFINE(z_main_stack, CONFIG_MAIN_STACK_SIZE);
 #endif
@@ -14,6 +14,7 @@
 #include "input/touchpad.h"
 #include "output/usb/hid.h"
 #include "output/usb/ps4/auth.h"
+#include "output/usb/report.h"
 #include "types.h"
 
 #define LOG_LEVEL LOG_LEVEL_INF
@@ -116,32 +117,13 @@ struct __attribute__((packed)) OutputReport {
   uint8_t right_stick_x;
   uint8_t right_stick_y;
 
-  // 4 bits for the d-pad.
-  uint32_t dpad : 4;
-
-  // 14 bits for buttons.
-  uint32_t button_west : 1;
-  uint32_t button_south : 1;
-  uint32_t button_east : 1;
-  uint32_t button_north : 1;
-  uint32_t button_l1 : 1;
-  uint32_t button_r1 : 1;
-  uint32_t button_l2 : 1;
-  uint32_t button_r2 : 1;
-  uint32_t button_select : 1;
-  uint32_t button_start : 1;
-  uint32_t button_l3 : 1;
-  uint32_t button_r3 : 1;
-  uint32_t button_home : 1;
-  uint32_t button_touchpad : 1;
-
-  // 6 bit report counter.
-  uint32_t report_counter : 6;
-
-  uint32_t left_trigger : 8;
-  uint32_t right_trigger : 8;
-
-  uint32_t padding : 24;
+  // 4 bits for the d-pad, 14 bits for buttons (see kPS4ReportLayout), and a 6 bit report counter.
+  uint8_t buttons[3];
+
+  uint8_t left_trigger;
+  uint8_t right_trigger;
+
+  uint8_t padding[3];
   uint8_t mystery[22];
   TouchpadData touchpad_data;
   uint8_t mystery_2[21];
@@ -149,6 +131,24 @@ struct __attribute__((packed)) OutputReport {
 
 static_assert(sizeof(OutputReport) == 64);
 
+static constexpr ReportLayout kPS4ReportLayout = {
+  .hat_shift = 0,
+  .hat_neutral = 15,
+  .buttons = {
+    // north, east, south, west
+    7, 6, 5, 4,
+    // l1, l2, l3, r1, r2, r3
+    8, 10, 14, 9, 11, 15,
+    // select, start, home, touchpad
+    12, 13, 16, 17,
+  },
+};
+
+static constexpr ReportEncoder kPS4ReportEncoder(kPS4ReportLayout);
+
+// The report counter is in the top 6 bits of the last byte of buttons.
+static constexpr uint8_t kPS4ReportCounterShift = 2;
+
 static bool check_crc(span<uint8_t> data) {
   if (data.size() < 4) {
     return false;
@@ -273,7 +273,32 @@ ssize_t PS4Hid::GetFeatureReport(uint8_t report_id, span<uint8_t> buf) {
   }
 }
 
-ssize_t PS4Hid::GetInputReport(uint8_t report_id, span<uint8_t> buf) {
+// Encode the parts of an input report that only depend on the InputState.
+static bool encode_input_report(const InputState& input, OutputReport* output) {
+  *output = {};
+  output->report_id = 0x01;
+  output->left_stick_x = input.left_stick_x;
+  output->left_stick_y = input.left_stick_y;
+  output->right_stick_x = input.right_stick_x;
+  output->right_stick_y = input.right_stick_y;
+
+  optional<uint32_t> buttons = kPS4ReportEncoder.encode(input);
+  if (!buttons) {
+    LOG_ERR("invalid stick state: %d", static_cast<int>(input.dpad));
+    return false;
+  }
+  memcpy(output->buttons, &*buttons, sizeof(output->buttons));
+
+  // TODO: Move this to InputState?
+  output->left_trigger = 0;
+  output->right_trigger = 0;
+  return true;
+}
+
+// Only used for interrupt reports.
+static CachedReport<OutputReport> cached_report;
+
+ssize_t PS4Hid::GetInputReport(uint8_t report_id, span<uint8_t> buf, bool interrupt) {
   switch (report_id) {
     case 0x01: {
       if (buf.size() != 64) {
@@ -287,70 +312,22 @@ ssize_t PS4Hid::GetInputReport(uint8_t report_id, span<uint8_t> buf) {
         return -1;
       }
 
-      OutputReport output = {};
-      output.report_id = 0x01;
-      output.left_stick_x = input.left_stick_x;
-      output.left_stick_y = input.left_stick_y;
-      output.right_stick_x = input.right_stick_x;
-      output.right_stick_y = input.right_stick_y;
-      switch (static_cast<StickState>(input.dpad)) {
-        case StickState::North:
-          output.dpad = 0;
-          break;
-        case StickState::NorthEast:
-          output.dpad = 1;
-          break;
-        case StickState::East:
-          output.dpad = 2;
-          break;
-        case StickState::SouthEast:
-          output.dpad = 3;
-          break;
-        case StickState::South:
-          output.dpad = 4;
-          break;
-        case StickState::SouthWest:
-          output.dpad = 5;
-          break;
-        case StickState::West:
-          output.dpad = 6;
-          break;
-        case StickState::NorthWest:
-          output.dpad = 7;
-          break;
-        case StickState::Neutral:
-          output.dpad = 15;
-          break;
-        default:
-          LOG_ERR("invalid stick state: %d", static_cast<int>(input.dpad));
+      OutputReport local;
+      OutputReport* output = &local;
+      if (interrupt) {
+        output = cached_report.get(input, encode_input_report);
+        if (!output) {
           return -1;
+        }
+      } else if (!encode_input_report(input, output)) {
+        return -1;
       }
 
-      output.button_north = input.button_north;
-      output.button_east = input.button_east;
-      output.button_south = input.button_south;
-      output.button_west = input.button_west;
-      output.button_l1 = input.button_l1;
-      output.button_l2 = input.button_l2;
-      output.button_l3 = input.button_l3;
-      output.button_r1 = input.button_r1;
-      output.button_r2 = input.button_r2;
-      output.button_r3 = input.button_r3;
-      output.button_select = input.button_select;
-      output.button_start = input.button_start;
-      output.button_home = input.button_home;
-      output.button_touchpad = input.button_touchpad;
-
-      output.report_counter = last_report_counter_++;
-
-      // TODO: Move this to InputState?
-      output.left_trigger = 0;
-      output.right_trigger = 0;
-
-      output.touchpad_data = touchpad_data;
-
-      memcpy(buf.data(), &output, buf.size());
+      output->buttons[2] = (output->buttons[2] & ((1 << kPS4ReportCounterShift) - 1)) |
+                           last_report_counter_++ << kPS4ReportCounterShift;
+      output->touchpad_data = touchpad_data;
 
+      memcpy(buf.data(), output, buf.size());
       return buf.size();
     }
 
@@ -369,7 +346,7 @@ ssize_t PS4Hid::GetReport(optional<HidReportType> report_type, uint8_t report_id
   } else if (*report_type == HidReportType::Feature) {
     return GetFeatureReport(report_id, buf);
   } else if (*report_type == HidReportType::Input) {
-    return GetInputReport(report_id, buf);
+    return GetInputReport(report_id, buf, false);
   } else if (*report_type == HidReportType::Output) {
     LOG_ERR("ignoring GetReport on output report %d", static_cast<int>(*report_type));
     return -1;
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "input/input.h"
+#include "types.h"
+
+// Declarative description of where a report puts the dpad and buttons of an InputState.
+//
+// Every report we emit packs the hat switch and buttons together into a little-endian word of up
+// to 32 bits. ReportEncoder turns this description into lookup tables at compile time, so that
+// encoding is a handful of table loads and mask/shift operations.
+struct ReportLayout {
+  // Bit offset of the 4-bit hat switch within the word.
+  uint8_t hat_shift;
+
+  // Value of the hat switch when the dpad is neutral.
+  uint8_t hat_neutral;
+
+  // Bit offset of each button within the word, in input_state_buttons order, or -1 if the report
+  // doesn't have the button.
+  int8_t buttons[INPUT_STATE_BUTTON_COUNT];
+};
+
+struct ReportEncoder {
+  explicit constexpr ReportEncoder(const ReportLayout& layout) {
+    // StickState::Neutral is 0, and the other directions go clockwise from North, like the hat.
+    hat[0] = layout.hat_neutral << layout.hat_shift;
+    for (size_t i = 1; i < HAT_STATES; ++i) {
+      hat[i] = (i - 1) << layout.hat_shift;
+    }
+
+    // Group buttons that move by the same distance, so that each group is one mask and shift.
+    for (size_t i = 0; i < INPUT_STATE_BUTTON_COUNT; ++i) {
+      if (layout.buttons[i] < 0) {
+        continue;
+      }
+
+      int shift = layout.buttons[i] - static_cast<int>(i);
+      size_t step = 0;
+      while (step < step_count && steps[step].shift() != shift) {
+        ++step;
+      }
+
+      if (step == step_count) {
+        ++step_count;
+        steps[step].left = shift > 0 ? shift : 0;
+        steps[step].right = shift < 0 ? -shift : 0;
+      }
+      steps[step].mask |= 1U << i;
+    }
+  }
+
+  optional<uint32_t> encode(StickState dpad, uint16_t buttons) const {
+    size_t hat_idx = static_cast<size_t>(dpad);
+    if (hat_idx >= HAT_STATES) {
+      return {};
+    }
+
+    uint32_t result = hat[hat_idx];
+    for (size_t i = 0; i < step_count; ++i) {
+      result |= ((buttons & steps[i].mask) << steps[i].left) >> steps[i].right;
+    }
+    return result;
+  }
+
+  optional<uint32_t> encode(const InputState& input) const {
+    return encode(input.dpad, input_state_buttons(input));
+  }
+
+ private:
+  static constexpr size_t HAT_STATES = 9;
+
+  struct Step {
+    constexpr int shift() const { return left - right; }
+
+    uint32_t mask = 0;
+    uint8_t left = 0;
+    uint8_t right = 0;
+  };
+
+  uint32_t hat[HAT_STATES] = {};
+  size_t step_count = 0;
+  Step steps[INPUT_STATE_BUTTON_COUNT] = {};
+};
+
+// The last encoded report, and the fingerprint of the InputState it was built from. Most
+// interrupt reports carry the same input as the previous one, so they can reuse its encoding.
+//
+// This isn't synchronized: control transfers can run concurrently with the interrupt path, so only
+// the interrupt path may use it, and everything else encodes into a local instead.
+template <typename Report>
+struct CachedReport {
+  // The report for input, encoded with encode(input, Report*) if it isn't already, or nullptr if
+  // encoding failed.
+  template <typename Encode>
+  Report* get(const InputState& input, Encode encode) {
+    uint64_t fingerprint = input_state_fingerprint(input);
+    if (!fingerprint_ || *fingerprint_ != fingerprint) {
+      fingerprint_.reset();
+      if (!encode(input, &report_)) {
+        return nullptr;
+      }
+      fingerprint_ = fingerprint;
+    }
+    return &report_;
+  }
+
+ private:
+  Report report_ = {};
+  optional<uint64_t> fingerprint_;
+};
@@ -0,0 +1,97 @@
+#include "profiling.h"
+
+#include <zephyr.h>
+
+#include "types.h"
+
+#if defined(CONFIG_PASSINGLINK_PROFILING)
+// Sites are pushed onto the front of this list when they're first reached, so it's in the reverse
+// of the order that prof_site_get uses.
+static ProfileSite* prof_sites;
+
+static void prof_site_register(ProfileSite* site) {
+  ProfileSite* head = __atomic_load_n(&prof_sites, __ATOMIC_ACQUIRE);
+  do {
+    site->next = head;
+  } while (!__atomic_compare_exchange_n(&prof_sites, &head, site, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_ACQUIRE));
+}
+
+void ProfileSite::record(uint32_t cycles) {
+  if (!atomic_get(&registered) && atomic_cas(&registered, 0, 1)) {
+    prof_site_register(this);
+  }
+
+  uint32_t call = atomic_inc(&calls);
+  samples[call % kSampleCount] = cycles;
+
+  uint32_t low = atomic_add(&total_low, cycles);
+  if (low + cycles < low) {
+    atomic_inc(&total_high);
+  }
+}
+
+size_t prof_site_count() {
+  size_t count = 0;
+  for (ProfileSite* site = __atomic_load_n(&prof_sites, __ATOMIC_ACQUIRE); site;
+       site = site->next) {
+    ++count;
+  }
+  return count;
+}
+
+bool prof_site_get(size_t idx, ProfSiteStats* out) {
+  ProfileSite* site = __atomic_load_n(&prof_sites, __ATOMIC_ACQUIRE);
+  size_t count = 0;
+  for (ProfileSite* it = site; it; it = it->next) {
+    ++count;
+  }
+
+  if (idx >= count) {
+    return false;
+  }
+
+  for (size_t i = count - 1 - idx; i > 0; --i) {
+    site = site->next;
+  }
+
+  out->name = site->name;
+  out->calls = atomic_get(&site->calls);
+
+  uint32_t high, low;
+  do {
+    high = atomic_get(&site->total_high);
+    low = atomic_get(&site->total_low);
+  } while (high != static_cast<uint32_t>(atomic_get(&site->total_high)));
+  out->total = static_cast<uint64_t>(high) << 32 | low;
+
+  // 25% resolution, up to ~1M cycles. Samples that are overwritten while this runs just show up
+  // as more recent samples.
+  Histogram<2, 20> histogram;
+  size_t samples = min(static_cast<size_t>(out->calls), ProfileSite::kSampleCount);
+  for (size_t i = 0; i < samples; ++i) {
+    histogram.record(site->samples[i]);
+  }
+  out->summary = histogram.summarize();
+  return true;
+}
+
+void prof_site_reset() {
+  for (ProfileSite* site = __atomic_load_n(&prof_sites, __ATOMIC_ACQUIRE); site;
+       site = site->next) {
+    atomic_set(&site->calls, 0);
+    atomic_set(&site->total_low, 0);
+    atomic_set(&site->total_high, 0);
+  }
+}
+#else
+size_t prof_site_count() {
+  return 0;
+}
+
+bool prof_site_get(size_t idx, ProfSiteStats* out) {
+  return false;
+}
+
+void prof_site_reset() {}
+#endif
@@ -1,69 +1,72 @@
 #pragma once
 
-#ifndef LOG_LEVEL
-#error LOG_LEVEL must be defined before including profiling.h.
-#endif
+#include <stddef.h>
+#include <stdint.h>
 
 #include "arch.h"
+#include "metrics/histogram.h"
+#include "types.h"
 
-#if defined(CONFIG_PASSINGLINK_PROFILING)
-template <int Frequency = 1>
-struct Profiler {
-  void begin() { begin_cycle_ = get_cycle_count(); }
-
-  void end(const char* name) {
-    if (times_count_ != Frequency) {
-      uint32_t end_cycle = get_cycle_count();
-      uint32_t diff = end_cycle - begin_cycle_;
-      times_[times_count_++] = diff;
-    } else {
-      times_count_ = 0;
-      u64_t total = 0;
-      uint32_t min = UINT32_MAX;
-      uint32_t max = 0;
-      for (auto time : times_) {
-        total += time;
-        if (time < min) {
-          min = time;
-        }
-        if (time > max) {
-          max = time;
-        }
-      }
-
-      uint32_t average = total / (Frequency - 1);
-      LOG_INF("%s: avg = %u, min = %u, max = %u", name, average, min, max);
-    }
-  }
-
-  uint32_t times_[Frequency - 1];
-  size_t times_count_;
+struct ProfSiteStats {
+  const char* name;
 
-  uint32_t begin_cycle_;
+  // Since the last reset. Cycles are as counted by get_cycle_count.
+  uint32_t calls;
+  uint64_t total;
+
+  // The distribution of the most recent ProfileSite::kSampleCount calls.
+  HistogramSummary summary;
 };
 
-template <int Frequency>
-struct ScopedProfile {
-  explicit ScopedProfile(Profiler<Frequency>& profiler, const char* name)
-      : profiler_(profiler), name_(name) {
-    profiler_.begin();
-  }
+// Registry of profiled sites, in the order they were first reached.
+size_t prof_site_count();
+bool prof_site_get(size_t idx, ProfSiteStats* out);
+void prof_site_reset();
+
+#if defined(CONFIG_PASSINGLINK_PROFILING)
+// Running statistics for a named piece of code, in cycles.
+//
+// Recording only does a few atomic operations and a store, without locking or logging, so that
+// profiling can stay enabled: the histogram is only built when a site is read through
+// prof_site_get, from the shell (`perf list`) or over the vendor HID interface.
+struct ProfileSite {
+  constexpr explicit ProfileSite(const char* name) : name(name) {}
+
+  void record(uint32_t cycles);
+
+  const char* name;
+  ProfileSite* next = nullptr;
+  atomic_t registered = 0;
 
-  ~ScopedProfile() { profiler_.end(name_); }
+  atomic_t calls = 0;
 
-  Profiler<Frequency>& profiler_;
-  const char* name_;
+  // The total number of cycles, split so that it can be updated atomically: total_high counts
+  // the carries out of total_low.
+  atomic_t total_low = 0;
+  atomic_t total_high = 0;
+
+  // A ring of the most recent samples, indexed by the number of calls.
+  static constexpr size_t kSampleCount = 64;
+  uint32_t samples[kSampleCount] = {};
 };
-#else
-template <int Frequency>
-struct Profiler {};
 
-template <int Frequency>
 struct ScopedProfile {
-  explicit ScopedProfile(Profiler<Frequency>& profiler, const char* name) {}
+  explicit ScopedProfile(ProfileSite& site) : site_(site), begin_cycle_(get_cycle_count()) {}
+  ~ScopedProfile() { site_.record(get_cycle_count() - begin_cycle_); }
+
+  ScopedProfile(const ScopedProfile& copy) = delete;
+  ScopedProfile(ScopedProfile&& move) = delete;
+
+  ProfileSite& site_;
+  uint32_t begin_cycle_;
 };
-#endif
 
-#define PROFILE(name, frequency)         \
-  static Profiler<frequency> __profiler; \
-  ScopedProfile<frequency> __scoped_profiler(__profiler, (name))
+// ProfileSite is constant-initialized, so this doesn't need a guard variable.
+#define PROFILE(name)                        \
+  static ProfileSite __profile_site((name)); \
+  ScopedProfile __scoped_profile(__profile_site)
+#else
+#define PROFILE(name) \
+  do {                \
+  } while (0)
+#endif
@@ -4,6 +4,11 @@
 
 #include "input/input.h"
 #include "input/queue.h"
+#include "input/record.h"
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+#include "output/usb/hid.h"
+#include "profiling.h"
 
 #if defined(CONFIG_PASSINGLINK_INPUT_SHELL)
 
@@ -73,9 +78,10 @@ static int cmd_input_home(const struct shell* shell, size_t argc, char** argv) {
     return 0;
   }
 
+  uint64_t elapsed_us = 0;
   head->state = {};
   head->state.button_home = 1;
-  head->delay = K_USEC(33'333);
+  head->delay = input_queue_delay_frames(&elapsed_us, 33'333);
 
   InputQueue* next = input_queue_append(head);
   if (!next) {
@@ -85,12 +91,19 @@ static int cmd_input_home(const struct shell* shell, size_t argc, char** argv) {
   }
 
   next->state = {};
-  next->delay = K_USEC(33'333);
+  next->delay = input_queue_delay_frames(&elapsed_us, 33'333);
 
   input_queue_set_active(head, true);
   return 0;
 }
 
+static int cmd_input_queue(const struct shell* shell, size_t argc, char** argv) {
+  InputQueueStats stats = input_queue_get_stats();
+  shell_print(shell, "in use: %zu/%zu bytes, high water: %zu bytes, allocation failures: %zu",
+              stats.in_use, stats.capacity, stats.high_water, stats.alloc_failures);
+  return 0;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 // clang-format off
@@ -100,6 +113,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_input,
   SHELL_CMD(modify, NULL, "Modify inputs.", cmd_input_modify),
 #endif
   SHELL_CMD(home, NULL, "Press home.", cmd_input_home),
+  SHELL_CMD(queue, NULL, "Print input queue statistics.", cmd_input_queue),
   SHELL_SUBCMD_SET_END
 );
 
@@ -108,3 +122,248 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_input,
 
 SHELL_CMD_REGISTER(input, &sub_input, "Input commands", 0);
 #endif
+
+#if defined(CONFIG_SHELL)
+static int cmd_metrics_latency(const struct shell* shell, size_t argc, char** argv) {
+  HistogramSummary latency = metrics_get_latency();
+  shell_print(shell, "reports: %u", latency.count);
+  shell_print(shell, "min: %uus, p50: %uus, p90: %uus, p99: %uus, p99.9: %uus, max: %uus",
+              latency.min, latency.p50, latency.p90, latency.p99, latency.p999, latency.max);
+  return 0;
+}
+
+static int cmd_metrics_histogram(const struct shell* shell, size_t argc, char** argv) {
+  // Too large to comfortably put on the shell's stack.
+  static LatencyHistogram histogram;
+  metrics_get_latency_histogram(&histogram);
+  for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+    if (histogram.counts_[i] == 0) {
+      continue;
+    }
+
+    if (i == LatencyHistogram::kOverflowBucket) {
+      shell_print(shell, ">= %uus: %u", LatencyHistogram::bucket_lower_bound(i),
+                  histogram.counts_[i]);
+    } else {
+      shell_print(shell, "%u-%uus: %u", LatencyHistogram::bucket_lower_bound(i),
+                  LatencyHistogram::bucket_upper_bound(i), histogram.counts_[i]);
+    }
+  }
+  return 0;
+}
+
+static int cmd_metrics_reset(const struct shell* shell, size_t argc, char** argv) {
+  metrics_reset();
+  return 0;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+// clang-format off
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_metrics,
+  SHELL_CMD(latency, NULL, "Print input to USB write latency.", cmd_metrics_latency),
+  SHELL_CMD(histogram, NULL, "Print the latency histogram.", cmd_metrics_histogram),
+  SHELL_CMD(reset, NULL, "Reset metrics.", cmd_metrics_reset),
+  SHELL_SUBCMD_SET_END
+);
+
+// clang-format on
+#pragma GCC diagnostic pop
+
+SHELL_CMD_REGISTER(metrics, &sub_metrics, "Metrics commands", 0);
+
+static int cmd_perf_list(const struct shell* shell, size_t argc, char** argv) {
+  ProfSiteStats stats;
+  for (size_t i = 0; prof_site_get(i, &stats); ++i) {
+    const HistogramSummary& summary = stats.summary;
+    uint32_t average = stats.calls ? stats.total / stats.calls : 0;
+    shell_print(shell, "%s: %u calls, avg = %u, min = %u, p50 = %u, p99 = %u, max = %u cycles",
+                stats.name, stats.calls, average, summary.min, summary.p50, summary.p99,
+                summary.max);
+  }
+  return 0;
+}
+
+static int cmd_perf_reset(const struct shell* shell, size_t argc, char** argv) {
+  prof_site_reset();
+  return 0;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+// clang-format off
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_perf,
+  SHELL_CMD(list, NULL, "Print profiled sites.", cmd_perf_list),
+  SHELL_CMD(reset, NULL, "Reset profiled sites.", cmd_perf_reset),
+  SHELL_SUBCMD_SET_END
+);
+
+// clang-format on
+#pragma GCC diagnostic pop
+
+SHELL_CMD_REGISTER(perf, &sub_perf, "Profiling commands", 0);
+#endif
+
+#if defined(CONFIG_SHELL)
+static const char* usb_poll_event_type_name(UsbPollEventType type) {
+  switch (type) {
+    case UsbPollEventType::MissedPoll:
+      return "missed polls";
+    case UsbPollEventType::Requeue:
+      return "failed writes";
+  }
+  return "<invalid>";
+}
+
+static int cmd_usb_poll(const struct shell* shell, size_t argc, char** argv) {
+  UsbPollStats stats = usb_hid_get_poll_stats();
+  const HistogramSummary& jitter = stats.jitter_us;
+  shell_print(shell, "intervals: %u, min = %u us, max = %u us", stats.intervals,
+              stats.interval_min_us, stats.interval_max_us);
+  shell_print(shell, "jitter: p50 = %u us, p99 = %u us, p99.9 = %u us, max = %u us", jitter.p50,
+              jitter.p99, jitter.p999, jitter.max);
+  shell_print(shell, "missed polls: %u, write failures: %u, requeues: %u, longest failure run: %u",
+              stats.missed_polls, stats.write_failures, stats.requeues,
+              stats.max_failure_streak);
+
+  UsbPollEvent events[16];
+  size_t count = usb_hid_get_poll_events(events);
+  for (size_t i = 0; i < count; ++i) {
+    const UsbPollEvent& event = events[i];
+    shell_print(shell, "%u ms: %u %s, backend = %s, report delay = %u us", event.uptime_ms,
+                event.count, usb_poll_event_type_name(event.type), event.backend,
+                event.report_delay_us);
+  }
+  return 0;
+}
+
+static int cmd_usb_reset(const struct shell* shell, size_t argc, char** argv) {
+  usb_hid_reset_poll_stats();
+  return 0;
+}
+
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+static int cmd_usb_sof(const struct shell* shell, size_t argc, char** argv) {
+  UsbSofStats stats = usb_hid_get_sof_stats();
+  shell_print(shell, "frames: %u, missed: %u, duplicated: %u", stats.frames, stats.missed,
+              stats.duplicated);
+  return 0;
+}
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+// clang-format off
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_usb,
+  SHELL_CMD(poll, NULL, "Print host polling statistics and events.", cmd_usb_poll),
+  SHELL_CMD(reset, NULL, "Reset host polling statistics and events.", cmd_usb_reset),
+#if defined(CONFIG_PASSINGLINK_OUTPUT_USB_SOF_SYNC)
+  SHELL_CMD(sof, NULL, "Print start of frame statistics.", cmd_usb_sof),
+#endif
+  SHELL_SUBCMD_SET_END
+);
+
+// clang-format on
+#pragma GCC diagnostic pop
+
+SHELL_CMD_REGISTER(usb, &sub_usb, "USB commands", 0);
+#endif
+
+#if defined(CONFIG_SHELL) && defined(CONFIG_PASSINGLINK_INPUT_RECORD)
+static int cmd_record_start(const struct shell* shell, size_t argc, char** argv) {
+  input_record_start();
+  return 0;
+}
+
+static int cmd_record_stop(const struct shell* shell, size_t argc, char** argv) {
+  input_record_stop();
+  input_record_replay_stop();
+  shell_print(shell, "recorded %zu bytes", input_record_export_size());
+  return 0;
+}
+
+static int cmd_record_replay(const struct shell* shell, size_t argc, char** argv) {
+  if (!input_record_replay_start()) {
+    shell_error(shell, "nothing recorded");
+    return 1;
+  }
+  return 0;
+}
+
+static int cmd_record_dump(const struct shell* shell, size_t argc, char** argv) {
+  uint8_t buf[32];
+  size_t offset = 0;
+  while (size_t length = input_record_export(offset, buf)) {
+    shell_hexdump(shell, buf, length);
+    offset += length;
+  }
+  return 0;
+}
+
+static int cmd_record_save(const struct shell* shell, size_t argc, char** argv) {
+  return input_record_save() ? 0 : 1;
+}
+
+static int cmd_record_load(const struct shell* shell, size_t argc, char** argv) {
+  return input_record_load() ? 0 : 1;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+// clang-format off
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_record,
+  SHELL_CMD(start, NULL, "Start recording inputs.", cmd_record_start),
+  SHELL_CMD(stop, NULL, "Stop recording or replaying inputs.", cmd_record_stop),
+  SHELL_CMD(replay, NULL, "Replay the recorded inputs.", cmd_record_replay),
+  SHELL_CMD(dump, NULL, "Dump the recording as hex.", cmd_record_dump),
+  SHELL_CMD(save, NULL, "Save the recording to flash.", cmd_record_save),
+  SHELL_CMD(load, NULL, "Load the recording from flash.", cmd_record_load),
+  SHELL_SUBCMD_SET_END
+);
+
+// clang-format on
+#pragma GCC diagnostic pop
+
+SHELL_CMD_REGISTER(record, &sub_record, "Input recording commands", 0);
+#endif
+
+#if defined(CONFIG_SHELL) && defined(CONFIG_PASSINGLINK_TRACE)
+static int cmd_trace_start(const struct shell* shell, size_t argc, char** argv) {
+  trace_start();
+  return 0;
+}
+
+static int cmd_trace_stop(const struct shell* shell, size_t argc, char** argv) {
+  trace_stop();
+  return 0;
+}
+
+static int cmd_trace_dump(const struct shell* shell, size_t argc, char** argv) {
+  trace_stop();
+
+  // Parsed by scripts/trace_to_json.py.
+  size_t count = trace_count();
+  shell_print(shell, "trace: %u cycles/s, %zu entries", sys_clock_hw_cycles_per_sec(), count);
+  for (size_t i = 0; i < count; ++i) {
+    TraceEntry entry = trace_get(i);
+    shell_print(shell, "%08x %08x %u %08x", entry.cycle, entry.context,
+                static_cast<unsigned>(entry.stage), entry.arg);
+  }
+  return 0;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+// clang-format off
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_trace,
+  SHELL_CMD(start, NULL, "Clear the trace buffer and start tracing.", cmd_trace_start),
+  SHELL_CMD(stop, NULL, "Stop tracing.", cmd_trace_stop),
+  SHELL_CMD(dump, NULL, "Stop tracing, and print the trace buffer.", cmd_trace_dump),
+  SHELL_SUBCMD_SET_END
+);
+
+// clang-format on
+#pragma GCC diagnostic pop
+
+SHELL_CMD_REGISTER(trace, &sub_trace, "Pipeline tracing commands", 0);
+#endif
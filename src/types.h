@@ -270,6 +270,84 @@ struct Bitmap {
   uint8_t data_[Length / 8];
 };
 
+// Lock-free ring buffer for a single producer and a single consumer.
+// Safe to push from an ISR while another context pops, without masking interrupts.
+template <typename T, size_t Capacity>
+struct spsc_queue {
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+  static_assert(__is_trivially_copyable(T));
+
+  bool push(const T& value) {
+    uint32_t head = atomic_get(&head_);
+    uint32_t tail = atomic_get(&tail_);
+    if (head - tail == Capacity) {
+      return false;
+    }
+
+    data_[head % Capacity] = value;
+    atomic_set(&head_, head + 1);
+    return true;
+  }
+
+  bool pop(T* out) {
+    uint32_t tail = atomic_get(&tail_);
+    if (tail == static_cast<uint32_t>(atomic_get(&head_))) {
+      return false;
+    }
+
+    *out = data_[tail % Capacity];
+    atomic_set(&tail_, tail + 1);
+    return true;
+  }
+
+  // Only safe to call from the consumer.
+  void clear() { atomic_set(&tail_, atomic_get(&head_)); }
+
+  bool empty() { return atomic_get(&head_) == atomic_get(&tail_); }
+
+ private:
+  atomic_t head_ = 0;
+  atomic_t tail_ = 0;
+  T data_[Capacity];
+};
+
+// Sequence lock, for publishing a value from a single writer without ever blocking it.
+// Readers retry if a write happened while they were copying, so the writer must not be
+// preemptible by readers (i.e. it must run at the same or a higher priority than them).
+template <typename T>
+struct seqlock {
+  static_assert(__is_trivially_copyable(T));
+
+  void store(const T& value) {
+    atomic_inc(&sequence_);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    value_ = value;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    atomic_inc(&sequence_);
+  }
+
+  T load() {
+    while (true) {
+      atomic_val_t begin = atomic_get(&sequence_);
+      if (begin & 1) {
+        continue;
+      }
+
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      T result = value_;
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+      if (atomic_get(&sequence_) == begin) {
+        return result;
+      }
+    }
+  }
+
+ private:
+  atomic_t sequence_ = 0;
+  T value_ = {};
+};
+
 template <typename T>
 void swap(T& a, T& b) {
   auto tmp = a;
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "input/input.h"
+#include "input/socd.h"
+
+// State that the firmware reads from modules that aren't built on the host: see stubs.cpp.
+extern OutputMode host_output_mode;
+extern optional<uint64_t> host_lock_tick;
+
+// A profile as it was written by hand before profiles became data: the SOCD inputs of each axis
+// are gathered into SOCDInputs and resolved with input_socd_parse, and buttons are remapped one by
+// one. The menu button isn't handled.
+//
+// Returns false if there's no reference for the profile.
+bool reference_profile_parse(const char* name, SOCDType x_type, SOCDType y_type,
+                             const ButtonHistory& history, InputState* out,
+                             const RawInputState* in);
@@ -0,0 +1,107 @@
+#include <time.h>
+
+#include "host.h"
+#include "input/pipeline.h"
+#include "input/profile.h"
+
+// Report the host's nanoseconds per call of each stage of parsing input. The host is much faster
+// than any of the boards, so compare these against each other rather than against a budget.
+
+static constexpr size_t kStateCount = 1024;
+static constexpr size_t kIterations = 1'000'000;
+
+// Pseudo-random presses of every input but the menu button, each with its own history.
+static InputPipeline pipelines[kStateCount];
+static RawInputState states[kStateCount];
+
+// The inputs of the Default profile's x axis, for input_socd_parse and input_socd_resolve.
+static SOCDInputs socd_inputs[kStateCount][2];
+static SOCDAxisIndex socd_index;
+
+static volatile uint64_t sink;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+static void generate_states() {
+  uint32_t input_mask = PL_GPIO_AVAILABLE_MASK & ~BIT(RawInputState::button_menu_offset);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < kStateCount; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    uint32_t raw = seed & input_mask;
+    states[i] = raw_input_state_from_mask(raw);
+
+    for (size_t input = 0; input < PL_GPIO_COUNT; ++input) {
+      seed = seed * 1664525 + 1013904223;
+      pipelines[i].button_history.values[input] = {
+        .state = static_cast<bool>((raw >> input) & 1),
+        .tick = seed >> 24,
+      };
+    }
+
+    const ButtonHistory& history = pipelines[i].button_history;
+    socd_inputs[i][0] = { states[i].stick_left, history.stick_left.tick, SOCDButtonType::Negative };
+    socd_inputs[i][1] = { states[i].stick_right, history.stick_right.tick,
+                          SOCDButtonType::Positive };
+  }
+
+  socd_index.add(RawInputState::stick_left_offset, SOCDButtonType::Negative, false);
+  socd_index.add(RawInputState::stick_right_offset, SOCDButtonType::Positive, false);
+}
+
+template <typename Fn>
+static void benchmark(const char* name, Fn fn) {
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < kIterations; ++i) {
+    fn(i % kStateCount);
+  }
+  uint64_t elapsed = now_ns() - start;
+  printf("%-40s %6.1f ns per call\n", name, static_cast<double>(elapsed) / kIterations);
+}
+
+int main() {
+  generate_states();
+
+  for (size_t type = 0; type < 4; ++type) {
+    char name[64];
+    snprintf(name, sizeof(name), "input_socd_parse (type %zu)", type);
+    benchmark(name, [type](size_t i) {
+      span<SOCDInputs> inputs(socd_inputs[i], ARRAY_SIZE(socd_inputs[i]));
+      sink = input_socd_parse(static_cast<SOCDType>(type), inputs).tick;
+    });
+
+    snprintf(name, sizeof(name), "input_socd_resolve (type %zu)", type);
+    benchmark(name, [type](size_t i) {
+      sink = input_socd_resolve(static_cast<SOCDType>(type), socd_index,
+                                raw_input_state_to_mask(states[i]), pipelines[i].button_history)
+               .tick;
+    });
+  }
+
+  for (size_t idx = 0; idx < input_profile_count(); ++idx) {
+    const char* profile = input_profile_get_name(idx);
+    for (size_t type = 0; type < 4; ++type) {
+      SOCDType socd_type = static_cast<SOCDType>(type);
+      char name[64];
+      snprintf(name, sizeof(name), "input_profile_parse (%s, type %zu)", profile, type);
+      benchmark(name, [idx, socd_type](size_t i) {
+        InputState out = {};
+        input_profile_parse(idx, socd_type, socd_type, &pipelines[i], &out, &states[i], 0);
+        sink = input_state_fingerprint(out);
+      });
+
+      snprintf(name, sizeof(name), "reference (%s, type %zu)", profile, type);
+      benchmark(name, [profile, socd_type](size_t i) {
+        InputState out = {};
+        reference_profile_parse(profile, socd_type, socd_type, pipelines[i].button_history, &out,
+                                &states[i]);
+        sink = input_state_fingerprint(out);
+      });
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,242 @@
+#include "host.h"
+#include "input/pipeline.h"
+#include "input/profile.h"
+
+// Print the first few mismatches of each check, and count the rest.
+static constexpr size_t kMaxReportedMismatches = 10;
+
+// Compare input_socd_resolve against input_socd_parse.
+static size_t check_socd() {
+  // Up to four inputs, each of which is either released or pressed at one of three ticks (so that
+  // every order of presses is covered, including simultaneous ones), of any button type, and
+  // overriding or not.
+  constexpr size_t kMaxInputs = 4;
+  constexpr size_t kInputStates = 4 * 3 * 2;
+
+  SOCDInputs inputs[kMaxInputs];
+  size_t failures = 0;
+  size_t combinations = 1;
+  for (size_t count = 0; count <= kMaxInputs; ++count, combinations *= kInputStates) {
+    for (size_t combination = 0; combination < combinations; ++combination) {
+      size_t state = combination;
+      for (size_t i = 0; i < count; ++i) {
+        uint64_t tick = state % 4;
+        state /= 4;
+        int button_type = static_cast<int>(state % 3) - 1;
+        state /= 3;
+        bool overrides = state % 2;
+        state /= 2;
+
+        inputs[i] = {
+          .input_value = tick != 0,
+          .input_tick = tick,
+          .button_type = static_cast<SOCDButtonType>(button_type),
+          .overrides = overrides,
+        };
+      }
+
+      // Input i is RawInputState offset i.
+      SOCDAxisIndex index;
+      ButtonHistory history = {};
+      uint32_t raw = 0;
+      for (size_t i = 0; i < count; ++i) {
+        index.add(i, inputs[i].button_type, inputs[i].overrides);
+        history.values[i].tick = inputs[i].input_tick;
+        raw |= inputs[i].input_value << i;
+      }
+
+      for (size_t type = 0; type < 4; ++type) {
+        span<SOCDInputs> buf(inputs, count);
+        StickOutput::Axis expected = input_socd_parse(static_cast<SOCDType>(type), buf);
+        StickOutput::Axis actual =
+          input_socd_resolve(static_cast<SOCDType>(type), index, raw, history);
+        if (expected.value == actual.value && expected.tick == actual.tick) {
+          continue;
+        }
+
+        if (failures++ < kMaxReportedMismatches) {
+          printf("socd: type %zu, %zu inputs, combination %zu: expected (%d, %" PRIu64
+                 "), got (%d, %" PRIu64 ")\n",
+                 type, count, combination, expected.value, expected.tick, actual.value,
+                 actual.tick);
+        }
+      }
+    }
+  }
+
+  printf("socd: %zu mismatches\n", failures);
+  return failures;
+}
+
+// Inputs that are SOCD inputs in at least one built-in profile.
+static constexpr uint8_t profile_socd_inputs[] = {
+  RawInputState::stick_up_offset,          RawInputState::stick_down_offset,
+  RawInputState::stick_right_offset,       RawInputState::stick_left_offset,
+  RawInputState::button_w_offset,          RawInputState::button_thumb_left_offset,
+  RawInputState::button_thumb_right_offset,
+};
+
+static constexpr size_t kSOCDInputCount = ARRAY_SIZE(profile_socd_inputs);
+
+// Events happen at ticks 1 to kSOCDInputCount, and are parsed afterwards.
+static constexpr uint64_t kParseTick = kSOCDInputCount + 1;
+
+// Every weak ordering of kSOCDInputCount events (i.e. including simultaneous ones), as the rank
+// of each event: the ranks used by an ordering are 0 to some n, with no gaps.
+struct Ordering {
+  uint8_t ranks[kSOCDInputCount];
+};
+
+static size_t orderings_count;
+static Ordering orderings[47293];  // The ordered Bell number of 7.
+
+static void generate_orderings() {
+  size_t candidates = 1;
+  for (size_t i = 0; i < kSOCDInputCount; ++i) {
+    candidates *= kSOCDInputCount;
+  }
+
+  for (size_t candidate = 0; candidate < candidates; ++candidate) {
+    Ordering ordering;
+    uint32_t used = 0;
+    size_t remaining = candidate;
+    for (size_t i = 0; i < kSOCDInputCount; ++i) {
+      ordering.ranks[i] = remaining % kSOCDInputCount;
+      remaining /= kSOCDInputCount;
+      used |= 1U << ordering.ranks[i];
+    }
+
+    if ((used & (used + 1)) == 0) {
+      orderings[orderings_count++] = ordering;
+    }
+  }
+}
+
+static const char* output_mode_name(OutputMode mode) {
+  switch (mode) {
+    case OutputMode::mode_dpad:
+      return "dpad";
+    case OutputMode::mode_ls:
+      return "ls";
+    case OutputMode::mode_rs:
+      return "rs";
+  }
+  return "<invalid>";
+}
+
+struct ProfileCheck {
+  size_t profile_idx;
+  const char* name;
+  InputPipeline pipeline = {};
+  size_t failures = 0;
+
+  // Parse the state in pipeline with both the profile and its reference, and compare them.
+  void run(SOCDType x_type, SOCDType y_type, const RawInputState& in) {
+    InputState expected = {};
+    InputState actual = {};
+    reference_profile_parse(name, x_type, y_type, pipeline.button_history, &expected, &in);
+    input_profile_parse(profile_idx, x_type, y_type, &pipeline, &actual, &in, kParseTick);
+
+    uint64_t expected_fingerprint = input_state_fingerprint(expected);
+    uint64_t actual_fingerprint = input_state_fingerprint(actual);
+    if (expected_fingerprint == actual_fingerprint) {
+      return;
+    }
+
+    if (failures++ < kMaxReportedMismatches) {
+      printf("%s: SOCD types (%zu, %zu), %s, %s, raw 0x%08x, ticks", name,
+             static_cast<size_t>(x_type), static_cast<size_t>(y_type),
+             output_mode_name(host_output_mode), host_lock_tick ? "locked" : "unlocked",
+             raw_input_state_to_mask(in));
+      for (uint8_t input : profile_socd_inputs) {
+        printf(" %" PRIu64, pipeline.button_history.values[input].tick);
+      }
+      printf(": expected 0x%" PRIx64 ", got 0x%" PRIx64 "\n", expected_fingerprint,
+             actual_fingerprint);
+    }
+  }
+};
+
+// Compare a built-in profile against its reference.
+static size_t check_profile(size_t profile_idx) {
+  ProfileCheck check = {
+    .profile_idx = profile_idx,
+    .name = input_profile_get_name(profile_idx),
+  };
+
+  // Pressing the menu button hands the inputs to the menu instead, which the reference doesn't do.
+  uint32_t socd_mask = 0;
+  for (uint8_t input : profile_socd_inputs) {
+    socd_mask |= BIT(input);
+  }
+  uint32_t button_mask =
+    PL_GPIO_AVAILABLE_MASK & ~socd_mask & ~BIT(RawInputState::button_menu_offset);
+
+  InputState unused;
+  RawInputState released = {};
+  if (!reference_profile_parse(check.name, SOCDType::Neutral, SOCDType::Neutral,
+                               check.pipeline.button_history, &unused, &released)) {
+    printf("%s: no reference profile\n", check.name);
+    return 1;
+  }
+
+  // Every subset of the SOCD inputs pressed, with their presses and the releases of the others
+  // in every order. Each state is parsed with every x SOCD type, and the y type, output mode and
+  // lock rotate from one state to the next. The other buttons follow a pattern that changes with
+  // every state.
+  size_t state = 0;
+  for (uint32_t pressed = 0; pressed < BIT(kSOCDInputCount); ++pressed) {
+    for (size_t ordering = 0; ordering < orderings_count; ++ordering, ++state) {
+      uint32_t raw = (state * 0x9e3779b9) & button_mask;
+      for (size_t i = 0; i < kSOCDInputCount; ++i) {
+        bool input_pressed = pressed & BIT(i);
+        ButtonHistory::Button& button =
+          check.pipeline.button_history.values[profile_socd_inputs[i]];
+        button.state = input_pressed;
+        button.tick = 1 + orderings[ordering].ranks[i];
+        raw |= input_pressed << profile_socd_inputs[i];
+      }
+
+      host_output_mode = static_cast<OutputMode>(state % 3);
+      host_lock_tick = (state / 3) % 2 ? optional<uint64_t>(0) : optional<uint64_t>();
+
+      RawInputState in = raw_input_state_from_mask(raw);
+      for (size_t x_type = 0; x_type < 4; ++x_type) {
+        size_t y_type = (x_type + state) % 4;
+        check.run(static_cast<SOCDType>(x_type), static_cast<SOCDType>(y_type), in);
+      }
+    }
+  }
+
+  // Every combination of the other buttons, with the SOCD inputs released.
+  for (size_t i = 0; i < kSOCDInputCount; ++i) {
+    check.pipeline.button_history.values[profile_socd_inputs[i]] = {};
+  }
+
+  for (size_t lock = 0; lock < 2; ++lock) {
+    host_lock_tick = lock ? optional<uint64_t>(0) : optional<uint64_t>();
+    uint32_t buttons = 0;
+    do {
+      RawInputState in = raw_input_state_from_mask(buttons);
+      check.run(SOCDType::Neutral, SOCDType::Neutral, in);
+      buttons = (buttons - button_mask) & button_mask;
+    } while (buttons != 0);
+  }
+
+  host_output_mode = OutputMode::mode_dpad;
+  host_lock_tick.reset();
+
+  printf("%s: %zu mismatches\n", check.name, check.failures);
+  return check.failures;
+}
+
+int main() {
+  size_t failures = check_socd();
+
+  generate_orderings();
+  for (size_t idx = 0; idx < input_profile_count(); ++idx) {
+    failures += check_profile(idx);
+  }
+
+  return failures ? 1 : 0;
+}
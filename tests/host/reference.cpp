@@ -0,0 +1,199 @@
+#include "host.h"
+
+// The built-in profiles as they were before ProfileDescriptor, kept as the reference that the
+// compiled profiles are checked against. Changes to a built-in profile need to be made here too.
+
+struct ReferenceMapping {
+#define PL_GPIO(index, name, available) uint8_t name;
+  PL_GPIOS()
+#undef PL_GPIO
+};
+
+static constexpr ReferenceMapping base_mapping() {
+  ReferenceMapping result = {};
+#define PL_GPIO(index, name, available) \
+  COND_CODE_1(available, (result.name = index;), (result.name = 0xff;))
+  PL_GPIOS()
+#undef PL_GPIO
+
+  return result;
+}
+
+static size_t default_socd_x(SOCDInputs* out, const RawInputState* in,
+                             const ButtonHistory& history) {
+  size_t i = 0;
+  out[i++] = { in->stick_left, history.stick_left.tick, SOCDButtonType::Negative };
+  out[i++] = { in->stick_right, history.stick_right.tick, SOCDButtonType::Positive };
+  return i;
+}
+
+static size_t default_socd_y(SOCDInputs* out, const RawInputState* in,
+                             const ButtonHistory& history) {
+  size_t i = 0;
+  out[i++] = { in->stick_up, history.stick_up.tick, SOCDButtonType::Negative };
+  out[i++] = { in->stick_down, history.stick_down.tick, SOCDButtonType::Positive };
+#if PL_GPIO_AVAILABLE(button_w)
+  out[i++] = { in->button_w, history.button_w.tick, SOCDButtonType::Negative };
+#endif
+  return i;
+}
+
+#if defined(CONFIG_PASSINGLINK_DISPLAY)
+static size_t dashblock_socd_x(SOCDInputs* out, const RawInputState* in,
+                               const ButtonHistory& history) {
+  size_t n = default_socd_x(out, in, history);
+#if PL_GPIO_AVAILABLE(button_thumb_left)
+  out[n++] = { in->button_thumb_left, history.button_thumb_left.tick, SOCDButtonType::Negative,
+               true };
+#endif
+#if PL_GPIO_AVAILABLE(button_thumb_right)
+  out[n++] = { in->button_thumb_right, history.button_thumb_right.tick, SOCDButtonType::Positive,
+               true };
+#endif
+  return n;
+}
+
+static size_t dashblock_socd_y(SOCDInputs* out, const RawInputState* in,
+                               const ButtonHistory& history) {
+  size_t n = default_socd_y(out, in, history);
+#if PL_GPIO_AVAILABLE(button_thumb_left)
+  out[n++] = { in->button_thumb_left, history.button_thumb_left.tick, SOCDButtonType::Neutral,
+               true };
+#endif
+#if PL_GPIO_AVAILABLE(button_thumb_right)
+  out[n++] = { in->button_thumb_right, history.button_thumb_right.tick, SOCDButtonType::Neutral,
+               true };
+#endif
+  return n;
+}
+
+static size_t tigerknee_socd_x(SOCDInputs* out, const RawInputState* in,
+                               const ButtonHistory& history) {
+  size_t n = default_socd_x(out, in, history);
+#if PL_GPIO_AVAILABLE(button_thumb_left)
+  out[n++] = { in->button_thumb_left, history.button_thumb_left.tick, SOCDButtonType::Negative,
+               true };
+#endif
+#if PL_GPIO_AVAILABLE(button_thumb_right)
+  out[n++] = { in->button_thumb_right, history.button_thumb_right.tick, SOCDButtonType::Positive,
+               true };
+#endif
+  return n;
+}
+
+static size_t tigerknee_socd_y(SOCDInputs* out, const RawInputState* in,
+                               const ButtonHistory& history) {
+  size_t n = default_socd_y(out, in, history);
+#if PL_GPIO_AVAILABLE(button_thumb_left)
+  out[n++] = { in->button_thumb_left, history.button_thumb_left.tick, SOCDButtonType::Negative,
+               true };
+#endif
+#if PL_GPIO_AVAILABLE(button_thumb_right)
+  out[n++] = { in->button_thumb_right, history.button_thumb_right.tick, SOCDButtonType::Negative,
+               true };
+#endif
+  return n;
+}
+#endif  // defined(CONFIG_PASSINGLINK_DISPLAY)
+
+struct ReferenceProfile {
+  const char* name;
+  ReferenceMapping mapping;
+  size_t (*socd_x)(SOCDInputs* out, const RawInputState* in, const ButtonHistory& history);
+  size_t (*socd_y)(SOCDInputs* out, const RawInputState* in, const ButtonHistory& history);
+};
+
+static constexpr ReferenceProfile reference_profiles[] = {
+  { "Default", base_mapping(), default_socd_x, default_socd_y },
+#if defined(CONFIG_PASSINGLINK_DISPLAY)
+  { "Dashblock", base_mapping(), dashblock_socd_x, dashblock_socd_y },
+  { "Tigerknee", base_mapping(), tigerknee_socd_x, tigerknee_socd_y },
+#endif
+};
+
+static bool get_bit(const void* ptr, size_t idx) {
+  auto p = static_cast<const char*>(ptr);
+  char byte = p[idx / 8];
+  return byte & 1 << (idx % 8);
+}
+
+static StickState stick_state_from_x_y(int horizontal, int vertical) {
+  static constexpr StickState states[3][3] = {
+    { StickState::NorthWest, StickState::North, StickState::NorthEast },
+    { StickState::West, StickState::Neutral, StickState::East },
+    { StickState::SouthWest, StickState::South, StickState::SouthEast },
+  };
+  return states[vertical + 1][horizontal + 1];
+}
+
+static uint8_t stick_scale(int sign) {
+  return sign < 0 ? 0x00 : sign == 0 ? 0x80 : 0xFF;
+}
+
+bool reference_profile_parse(const char* name, SOCDType x_type, SOCDType y_type,
+                             const ButtonHistory& history, InputState* out,
+                             const RawInputState* in) {
+  const ReferenceProfile* profile = nullptr;
+  for (const ReferenceProfile& reference : reference_profiles) {
+    if (strcmp(reference.name, name) == 0) {
+      profile = &reference;
+    }
+  }
+
+  if (!profile) {
+    return false;
+  }
+
+  SOCDInputs x_inputs[PROFILE_MAX_SOCD_INPUTS];
+  SOCDInputs y_inputs[PROFILE_MAX_SOCD_INPUTS];
+  size_t x_count = profile->socd_x(x_inputs, in, history);
+  size_t y_count = profile->socd_y(y_inputs, in, history);
+  StickOutput stick_output = {
+    .x = input_socd_parse(x_type, span<SOCDInputs>(x_inputs, x_count)),
+    .y = input_socd_parse(y_type, span<SOCDInputs>(y_inputs, y_count)),
+  };
+
+  const ReferenceMapping* mapping = &profile->mapping;
+#define BUTTONS()       \
+  BUTTON(button_north)  \
+  BUTTON(button_east)   \
+  BUTTON(button_south)  \
+  BUTTON(button_west)   \
+  BUTTON(button_l1)     \
+  BUTTON(button_l2)     \
+  BUTTON(button_l3)     \
+  BUTTON(button_r1)     \
+  BUTTON(button_r2)     \
+  BUTTON(button_r3)     \
+  BUTTON(button_select) \
+  BUTTON(button_start)  \
+  BUTTON(button_home)   \
+  BUTTON(button_touchpad)
+#define BUTTON(name) out->name = (mapping->name == 0xff) ? 0 : get_bit(in, mapping->name);
+  BUTTONS();
+#undef BUTTON
+#undef BUTTONS
+
+  switch (input_get_output_mode()) {
+    case OutputMode::mode_dpad:
+      out->dpad = stick_state_from_x_y(stick_output.x.value, stick_output.y.value);
+      break;
+
+    case OutputMode::mode_ls:
+      out->left_stick_x = stick_scale(stick_output.x.value);
+      out->left_stick_y = stick_scale(stick_output.y.value);
+      break;
+
+    case OutputMode::mode_rs:
+      out->right_stick_x = stick_scale(stick_output.x.value);
+      out->right_stick_y = stick_scale(stick_output.y.value);
+      break;
+  }
+
+  if (input_get_lock_tick()) {
+    out->button_select = 0;
+    out->button_start = 0;
+    out->button_home = 0;
+  }
+  return true;
+}
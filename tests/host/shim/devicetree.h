@@ -0,0 +1,37 @@
+#pragma once
+
+// A board with every input of PL_GPIOS, so that every built-in profile has all of its inputs.
+// PL_GPIO_AVAILABLE(name) expands to DT_NODE_HAS_STATUS(PL_HOST_GPIO_name, okay), which is 1 for
+// each of the nodes defined here, and 0 otherwise.
+#define DT_PATH(parent, name) PL_HOST_GPIO_##name
+#define DT_NODE_HAS_STATUS(node, status) Z_DT_CAT(node, _EXISTS)
+#define Z_DT_CAT(a, b) Z_DT_CAT_(a, b)
+#define Z_DT_CAT_(a, b) a##b
+
+#define PL_HOST_GPIO_stick_up_EXISTS 1
+#define PL_HOST_GPIO_stick_down_EXISTS 1
+#define PL_HOST_GPIO_stick_right_EXISTS 1
+#define PL_HOST_GPIO_stick_left_EXISTS 1
+#define PL_HOST_GPIO_button_north_EXISTS 1
+#define PL_HOST_GPIO_button_east_EXISTS 1
+#define PL_HOST_GPIO_button_south_EXISTS 1
+#define PL_HOST_GPIO_button_west_EXISTS 1
+#define PL_HOST_GPIO_button_l1_EXISTS 1
+#define PL_HOST_GPIO_button_l2_EXISTS 1
+#define PL_HOST_GPIO_button_l3_EXISTS 1
+#define PL_HOST_GPIO_button_r1_EXISTS 1
+#define PL_HOST_GPIO_button_r2_EXISTS 1
+#define PL_HOST_GPIO_button_r3_EXISTS 1
+#define PL_HOST_GPIO_button_start_EXISTS 1
+#define PL_HOST_GPIO_button_select_EXISTS 1
+#define PL_HOST_GPIO_button_home_EXISTS 1
+#define PL_HOST_GPIO_button_touchpad_EXISTS 1
+#define PL_HOST_GPIO_button_menu_EXISTS 1
+#define PL_HOST_GPIO_button_w_EXISTS 1
+#define PL_HOST_GPIO_button_thumb_left_EXISTS 1
+#define PL_HOST_GPIO_button_thumb_right_EXISTS 1
+#define PL_HOST_GPIO_mode_lock_EXISTS 1
+#define PL_HOST_GPIO_mode_ps3_EXISTS 1
+#define PL_HOST_GPIO_mode_ls_EXISTS 1
+#define PL_HOST_GPIO_mode_rs_EXISTS 1
+#define PL_HOST_GPIO_mode_dpad_EXISTS 1
@@ -0,0 +1,3 @@
+#pragma once
+
+// There's no flash on the host: see storage/flash_map.h.
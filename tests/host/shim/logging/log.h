@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+
+#define LOG_LEVEL_ERR 1
+#define LOG_LEVEL_WRN 2
+#define LOG_LEVEL_INF 3
+#define LOG_LEVEL_DBG 4
+
+#define LOG_MODULE_REGISTER(name) static_assert(true)
+
+#define LOG_ERR(fmt, ...) fprintf(stderr, "error: " fmt "\n", ##__VA_ARGS__)
+#define LOG_WRN(fmt, ...) fprintf(stderr, "warning: " fmt "\n", ##__VA_ARGS__)
+#define LOG_INF(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define LOG_DBG(fmt, ...) \
+  do {                    \
+  } while (0)
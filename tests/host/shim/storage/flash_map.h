@@ -0,0 +1,4 @@
+#pragma once
+
+// There's no flash on the host, so custom profiles can't be stored.
+#define FLASH_AREA_LABEL_EXISTS(label) 0
@@ -0,0 +1,21 @@
+#pragma once
+
+typedef long atomic_t;
+typedef long atomic_val_t;
+
+inline atomic_val_t atomic_get(const atomic_t* target) {
+  return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+inline atomic_val_t atomic_set(atomic_t* target, atomic_val_t value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline atomic_val_t atomic_inc(atomic_t* target) {
+  return __atomic_fetch_add(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline bool atomic_cas(atomic_t* target, atomic_val_t old_value, atomic_val_t new_value) {
+  return __atomic_compare_exchange_n(target, &old_value, new_value, false, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_SEQ_CST);
+}
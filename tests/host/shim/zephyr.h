@@ -0,0 +1,52 @@
+#pragma once
+
+// Just enough of Zephyr to build the input parsing code on the host: see tests/host/CMakeLists.txt.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "devicetree.h"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define BIT(n) (1UL << (n))
+#define BIT_MASK(n) (BIT(n) - 1UL)
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+// From sys/util_macro.h.
+#define Z_XXX_1 _YYYY,
+#define COND_CODE_1(flag, if_1_code, else_code) Z_COND_CODE_1(flag, if_1_code, else_code)
+#define Z_COND_CODE_1(flag, if_1_code, else_code) \
+  Z_COND_CODE(Z_XXX_##flag, if_1_code, else_code)
+#define Z_COND_CODE(one_or_two_args, if_code, else_code) \
+  Z_GET_ARG2_DEBRACKET(one_or_two_args if_code, else_code)
+#define Z_GET_ARG2_DEBRACKET(ignore_this, val, ...) Z_DEBRACKET val
+#define Z_DEBRACKET(...) __VA_ARGS__
+
+#define printk printf
+#define k_panic() abort()
+
+inline unsigned int irq_lock() {
+  return 0;
+}
+
+inline void irq_unlock(unsigned int key) {}
+
+// The hardware cycle counter is CLOCK_MONOTONIC, in nanoseconds.
+uint32_t sys_clock_hw_cycles_per_sec();
+uint32_t k_cycle_get_32();
+
+#define k_ms_to_cyc_ceil32(ms) static_cast<uint32_t>((ms) * UINT64_C(1'000'000))
+#define k_ms_to_cyc_ceil64(ms) static_cast<uint64_t>((ms) * UINT64_C(1'000'000))
+#define k_us_to_cyc_ceil32(us) static_cast<uint32_t>((us) * UINT64_C(1'000))
+#define k_cyc_to_us_floor32(cyc) static_cast<uint32_t>((cyc) / UINT64_C(1'000))
+#define k_cyc_to_ns_floor64(cyc) static_cast<uint64_t>(cyc)
+
+struct k_thread;
+
+inline k_thread* k_current_get() {
+  return nullptr;
+}
@@ -0,0 +1,29 @@
+#include <time.h>
+
+#include "display/menu.h"
+#include "host.h"
+
+OutputMode host_output_mode = OutputMode::mode_dpad;
+optional<uint64_t> host_lock_tick;
+
+uint32_t sys_clock_hw_cycles_per_sec() {
+  return 1'000'000'000;
+}
+
+uint32_t k_cycle_get_32() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+OutputMode input_get_output_mode() {
+  return host_output_mode;
+}
+
+optional<uint64_t> input_get_lock_tick() {
+  return host_lock_tick;
+}
+
+void menu_open() {}
+void menu_close() {}
+void menu_input(MenuInput input) {}